@@ -0,0 +1,210 @@
+/**
+ * @file arrayPool.cpp
+ *
+ * @brief Implementation of the pool for the memory of the arrays
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "blitz/array.h"
+#include "arrayPool.h"
+
+const size_t AlignedAllocator::ALIGNMENT;
+const size_t AlignedAllocator::HUGE_PAGE_BYTES;
+const size_t AlignedAllocator::FIRST_TOUCH_BYTES;
+
+/**
+ * @brief Constructor
+ *
+ * @param hugePages if true, the large arrays are backed by huge pages
+ * when the system has them
+ */
+AlignedAllocator::AlignedAllocator(bool hugePages)
+    : hugePages(hugePages)
+{}
+
+/**
+ * @brief Gets aligned memory for an array
+ */
+void* AlignedAllocator::allocate(size_t bytes)
+{
+    const bool huge=(bytes>=HUGE_PAGE_BYTES);
+    void* result=0;
+    if (posix_memalign(&result, huge? HUGE_PAGE_BYTES : ALIGNMENT, 
+		bytes>0? bytes : 1)!=0)
+	throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    // only a hint: without huge pages the memory works all the same
+    if (huge && hugePages)
+	madvise(result, bytes, MADV_HUGEPAGE);
+#endif
+
+    if (bytes>=FIRST_TOUCH_BYTES)
+    {
+	char* data=static_cast<char*>(result);
+	const long pageBytes=sysconf(_SC_PAGESIZE);
+	const long pages=(bytes+pageBytes-1)/pageBytes;
+#pragma omp parallel for schedule(static)
+	for (long page=0; page<pages; page++)
+	    data[page*pageBytes]=0;
+    }
+    return result;
+}
+
+/**
+ * @brief Gives back the memory of an array
+ */
+void AlignedAllocator::deallocate(void* data, size_t)
+{
+    free(data);
+}
+
+/**
+ * @brief Constructor: the pool is empty and not installed
+ *
+ * @param minimumBytes arrays smaller than this are not pooled
+ * @param hugePages if true, the large arrays are backed by huge pages
+ * when the system has them
+ */
+ArrayPool::ArrayPool(size_t minimumBytes, bool hugePages)
+    : minimumBytes(minimumBytes), memory(hugePages), installed(false)
+{}
+
+/**
+ * @brief Destructor: uninstalls the pool and frees its memory
+ *
+ * All the arrays allocated from the pool must be gone by now, so create
+ * the pool before them.
+ */
+ArrayPool::~ArrayPool()
+{
+    uninstall();
+    std::map<size_t, SizeClass>::iterator it;
+    for (it=sizes.begin(); it!=sizes.end(); ++it)
+	for (size_t b=0; b<it->second.pooled.size(); b++)
+	    memory.deallocate(it->second.pooled[b], it->first);
+}
+
+/**
+ * @brief Makes Blitz++ allocate the new arrays from the pool
+ *
+ * Call it before any other thread creates arrays.
+ */
+void ArrayPool::install()
+{
+    blitz::setMemoryBlockAllocator(this);
+    installed=true;
+}
+
+/**
+ * @brief Makes Blitz++ allocate the new arrays with new[] again
+ *
+ * The arrays already allocated from the pool still give their memory
+ * back to it.
+ */
+void ArrayPool::uninstall()
+{
+    if (installed && blitz::memoryBlockAllocator()==this)
+	blitz::setMemoryBlockAllocator(0);
+    installed=false;
+}
+
+/**
+ * @brief Gets memory for an array, from the pool if there is a block of
+ * the same size, or else from the aligned allocator
+ */
+void* ArrayPool::allocate(size_t bytes)
+{
+    if (bytes>=minimumBytes)
+    {
+	std::lock_guard<std::mutex> lock(poolMutex);
+	counts.allocations++;
+	SizeClass& size=sizes[bytes];
+	if (!size.pooled.empty())
+	{
+	    void* result=size.pooled.back();
+	    size.pooled.pop_back();
+	    if (size.pooled.size()<size.leastPooled)
+		size.leastPooled=size.pooled.size();
+	    counts.reused++;
+	    counts.pooledBytes-=bytes;
+	    return result;
+	}
+    }
+
+    return memory.allocate(bytes);
+}
+
+/**
+ * @brief Takes back the memory of an array, keeping it in the pool
+ */
+void ArrayPool::deallocate(void* data, size_t bytes)
+{
+    if (bytes<minimumBytes)
+    {
+	memory.deallocate(data, bytes);
+	return;
+    }
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    sizes[bytes].pooled.push_back(data);
+    counts.pooledBytes+=bytes;
+    if (counts.pooledBytes>counts.peakPooledBytes)
+	counts.peakPooledBytes=counts.pooledBytes;
+}
+
+/**
+ * @brief A function to call at the end of each DMRG step: gives back to
+ * the system the memory that was not used in the step
+ */
+void ArrayPool::endStep()
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    std::map<size_t, SizeClass>::iterator it=sizes.begin();
+    while (it!=sizes.end())
+    {
+	SizeClass& size=it->second;
+	for (size_t b=0; b<size.leastPooled; b++)
+	{
+	    memory.deallocate(size.pooled.back(), it->first);
+	    size.pooled.pop_back();
+	    counts.pooledBytes-=it->first;
+	    counts.released++;
+	}
+	size.leastPooled=size.pooled.size();
+	if (size.pooled.empty())
+	    sizes.erase(it++);
+	else
+	    ++it;
+    }
+}
+
+/**
+ * @brief A function to get what the pool has been doing
+ */
+ArrayPool::Statistics ArrayPool::statistics() const
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return counts;
+}
+
+/**
+ * @brief A function to print what the pool has been doing
+ */
+void ArrayPool::printStatistics(std::ostream& os) const
+{
+    const Statistics s=statistics();
+    os<<"array pool: "<<s.allocations<<" allocations, "<<s.reused
+	<<" served from the pool (mallocs saved), "<<s.released
+	<<" released, "<<s.peakPooledBytes/(1024.0*1024.0)
+	<<" MB pooled at most\n";
+}
+// end arrayPool.cpp
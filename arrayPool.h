@@ -0,0 +1,139 @@
+/**
+ * @file arrayPool.h
+ *
+ * @brief A pool that reuses the memory of the Blitz++ arrays from one
+ * DMRG step to the next
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#ifndef ARRAY_POOL_H
+#define ARRAY_POOL_H
+
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "blitz/array.h"
+
+/**
+ * @brief An allocator for the memory of the Blitz++ arrays that aligns it
+ * for the vector instructions
+ *
+ * Every array starts at a multiple of ALIGNMENT bytes, so it starts a
+ * cache line and the vectorized kernels can use aligned loads on it.
+ * Arrays of HUGE_PAGE_BYTES or more start at a multiple of
+ * HUGE_PAGE_BYTES, and if hugePages is true the system is asked to back
+ * them with huge pages, so they need fewer TLB entries.
+ *
+ * The pages of the arrays of FIRST_TOUCH_BYTES or more are touched for
+ * the first time by all the threads, each one a share as in a static
+ * OpenMP loop. The system puts each page in the NUMA node of the thread
+ * that touches it first, so the memory ends up spread across the nodes
+ * like the work of the parallel loops, instead of in the node of the
+ * thread that allocated it. Without threads this does nothing.
+ *
+ * It can be installed by itself (see blitz::setMemoryBlockAllocator()),
+ * and ArrayPool takes its memory from it.
+ */
+class AlignedAllocator : public blitz::MemoryBlockAllocator {
+    public:
+	/// alignment of all the arrays, in bytes
+	static const size_t ALIGNMENT=64;
+	/// size of a huge page, and alignment of the arrays this large
+	static const size_t HUGE_PAGE_BYTES=size_t(2)<<20;
+	/// arrays this large are first touched by all the threads
+	static const size_t FIRST_TOUCH_BYTES=size_t(1)<<20;
+
+	explicit AlignedAllocator(bool hugePages=true);
+
+	void* allocate(size_t bytes);
+	void deallocate(void* data, size_t bytes);
+
+    private:
+	bool hugePages;
+};
+
+/**
+ * @brief A pool for the memory of the Blitz++ arrays
+ *
+ * Once installed (see install()), Blitz++ asks the pool for the memory
+ * of every new array. The memory of the arrays that are destroyed is
+ * kept in the pool, by size, and handed out again to the next array of
+ * the same size. Every DMRG step creates the same temporaries as the
+ * step before (the superblock Hamiltonian, the wavefunctions, the density
+ * matrix, the transformed operators...), so after the first steps they
+ * are served from the pool: no calls to malloc, and no page faults on
+ * freshly mapped memory.
+ *
+ * Call endStep() at the end of each step: the memory that was in the
+ * pool for the whole step, unused, goes back to the system. That way the
+ * pool follows the sizes of the arrays as the blocks grow, and it never
+ * keeps more than the arrays of a step.
+ *
+ * The memory that is not in the pool comes from an AlignedAllocator.
+ * Arrays smaller than minimumBytes are not pooled; malloc is good at
+ * them. All the functions can be called from any thread.
+ */
+class ArrayPool : public blitz::MemoryBlockAllocator {
+    public:
+	/// what the pool has been doing
+	struct Statistics {
+	    /// number of arrays allocated through the pool
+	    size_t allocations;
+	    /// number of them served with memory from the pool
+	    size_t reused;
+	    /// number of memory blocks given back to the system by endStep()
+	    size_t released;
+	    /// bytes in the pool now
+	    size_t pooledBytes;
+	    /// maximum number of bytes in the pool
+	    size_t peakPooledBytes;
+
+	    Statistics() : allocations(0), reused(0), released(0),
+		pooledBytes(0), peakPooledBytes(0) {}
+	};
+
+	explicit ArrayPool(size_t minimumBytes=4096, bool hugePages=true);
+	~ArrayPool();
+
+	void install();
+	void uninstall();
+
+	void* allocate(size_t bytes);
+	void deallocate(void* data, size_t bytes);
+	void endStep();
+
+	Statistics statistics() const;
+	void printStatistics(std::ostream& os) const;
+
+    private:
+	/// the pooled memory blocks of a size
+	struct SizeClass {
+	    /// the blocks in the pool
+	    std::vector<void*> pooled;
+	    /// the least number of blocks in the pool during this step
+	    size_t leastPooled;
+
+	    SizeClass() : leastPooled(0) {}
+	};
+
+	size_t minimumBytes;
+	/// where the memory that is not in the pool comes from
+	AlignedAllocator memory;
+	/// true if Blitz++ is using the pool
+	bool installed;
+	std::map<size_t, SizeClass> sizes;
+	Statistics counts;
+	mutable std::mutex poolMutex;
+
+	// not copyable
+	ArrayPool(const ArrayPool&);
+	void operator=(const ArrayPool&);
+};
+
+#endif // ARRAY_POOL_H
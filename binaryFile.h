@@ -0,0 +1,100 @@
+/**
+ * @file binaryFile.h
+ *
+ * @brief A small helper to write and read binary files field by field
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#ifndef BINARY_FILE_H
+#define BINARY_FILE_H
+
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include "blitz/array.h"
+
+/**
+ * @brief A binary file being written or read
+ *
+ * Values are written as their bytes. Arrays are written as their shape
+ * followed by the elements in row-major order, strings as their size
+ * followed by the characters. Errors are not reported one by one: ok
+ * becomes false and everything after that does nothing, so check ok (or
+ * the result of close()) once you are done.
+ */
+class BinaryFile {
+    public:
+	BinaryFile(const std::string& fname, const char* mode)
+	    : fname(fname), file(fopen(fname.c_str(), mode)), ok(file!=0) {}
+	~BinaryFile() { if (file) fclose(file); }
+
+	void write(const void* data, size_t bytes)
+	{
+	    ok=ok && (bytes==0 || fwrite(data, bytes, 1, file)==1);
+	}
+	template<typename T> void write(const T& value)
+	{
+	    write(&value, sizeof(T));
+	}
+	void write(const std::string& value)
+	{
+	    write(int64_t(value.size()));
+	    write(value.data(), value.size());
+	}
+	template<int N> void write(const blitz::Array<double,N>& array)
+	{
+	    blitz::Array<double,N> data(array.shape());
+	    data=array;
+	    for (int d=0; d<N; d++)
+		write(int64_t(data.extent(d)));
+	    write(data.data(), data.numElements()*sizeof(double));
+	}
+
+	void read(void* data, size_t bytes)
+	{
+	    ok=ok && (bytes==0 || fread(data, bytes, 1, file)==1);
+	}
+	template<typename T> void read(T& value)
+	{
+	    read(&value, sizeof(T));
+	}
+	/// reads a size, checking it is reasonable
+	size_t readSize(size_t elementBytes)
+	{
+	    int64_t size=0;
+	    read(size);
+	    ok=ok && size>=0 && size<(int64_t(1)<<40)/int64_t(elementBytes);
+	    return ok? size : 0;
+	}
+	void read(std::string& value)
+	{
+	    value.resize(readSize(1));
+	    read(&value[0], value.size());
+	}
+	template<int N> void read(blitz::Array<double,N>& array)
+	{
+	    blitz::TinyVector<int,N> shape;
+	    for (int d=0; d<N; d++)
+		shape(d)=readSize(sizeof(double));
+	    array.reference(blitz::Array<double,N>(shape));
+	    read(array.data(), array.numElements()*sizeof(double));
+	}
+
+	/// closes the file, returning false if anything failed
+	bool close()
+	{
+	    ok=(fclose(file)==0) && ok;
+	    file=0;
+	    return ok;
+	}
+
+	const std::string fname;
+	FILE* file;
+	bool ok;
+};
+
+#endif // BINARY_FILE_H
@@ -718,6 +718,27 @@ public:
         reference(const_cast<T_array&>(array));
     }
 
+    /*
+     * Move constructor: takes the data of array without counting a
+     * reference, and its ownership if array is the single owner of the
+     * data (see singleOwner()).  array is left empty.
+     */
+    Array(Array<T_numtype, N_rank>&& array)
+#ifdef BZ_NEW_EXPRESSION_TEMPLATES
+        : MemoryBlockReference<T_numtype>(),
+          ETBase< Array<T_numtype, N_rank> >(array)
+#else
+        : MemoryBlockReference<T_numtype>()
+#endif
+    {
+        storage_ = array.storage_;
+        length_ = array.length_;
+        stride_ = array.stride_;
+        zeroOffset_ = array.zeroOffset_;
+        T_base::swapBlock(array);
+        array.length_ = 0;
+    }
+
     /*
      * These constructors are used for creating interlaced arrays (see
      * <blitz/arrayshape.h>
@@ -991,6 +1012,12 @@ public:
     void                              reference(const T_array&);
     void                              weakReference(const T_array&);
 
+    // View the elements of another array, of any rank, with a new shape
+    template<int N_rank2>
+    void                              referenceReshaped(
+                                        const Array<T_numtype,N_rank2>&,
+                                        const TinyVector<int,N_rank>&);
+
     // Added by Derrick Bass
     T_array                           reindex(const TinyVector<int,N_rank>&);
     void                              reindexSelf(
@@ -1123,6 +1150,14 @@ public:
     bool                              threadLocal(bool disableLock = true) const
         { return T_base::lockReferenceCount(!disableLock); }
 
+    // Make this array the single owner of its memory: the views of it
+    // are not counted, and the memory goes with this array.  The views
+    // must not outlive it (or its next resize), and it must stay in place
+    // (not be copied around, e.g. in a std::vector).  Only possible while
+    // there are no other references to the memory.
+    bool                              singleOwner() const
+        { return T_base::ownBlock(); }
+
     int                               ubound(int rank) const
     { return base(rank) + length_(rank) - 1; }
 
@@ -2193,6 +2228,10 @@ public:
     // Was:
     // T_array& operator=(T_numtype);
 
+    // Takes the memory of x instead of copying its elements when nothing
+    // else refers to either array (see <blitz/array/ops.cc>)
+    T_array& operator=(Array<T_numtype,N_rank>&& x);
+
 #ifdef BZ_NEW_EXPRESSION_TEMPLATES
     template<typename T_expr>
     T_array& operator=(const ETBase<T_expr>&);
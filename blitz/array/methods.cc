@@ -209,6 +209,33 @@ void Array<P_numtype, N_rank>::reference(const Array<P_numtype, N_rank>& array)
     T_base::changeBlock(array.noConst());
 }
 
+/*
+ * Make this array a view of another array's data with a new shape: the
+ * elements are taken in row-major order. The other array must be stored
+ * in row-major order without gaps (e.g. a freshly allocated array, but
+ * not a transpose or a strided slice), and have as many elements as the
+ * new shape. The view shares the memory block, like reference().
+ */
+template<typename P_numtype, int N_rank> template<int N_rank2>
+void Array<P_numtype, N_rank>::referenceReshaped(
+    const Array<P_numtype, N_rank2>& array, const TinyVector<int,N_rank>& shape)
+{
+    bool rowMajor = (array.stride(N_rank2-1) == 1);
+    for (int i=0; i < N_rank2-1; ++i)
+        rowMajor = rowMajor && 
+            (array.stride(i) == array.stride(i+1) * array.extent(i+1));
+    BZPRECHECK(rowMajor && product(shape) == array.numElements(),
+        "referenceReshaped: the array is not stored in row-major order "
+        << "or has a different number of elements");
+
+    storage_ = GeneralArrayStorage<N_rank>();
+    length_ = shape;
+    T_base::changeBlock(array.noConst(),
+        array.dataFirst() - array.noConst().data());
+    computeStrides();
+    zeroOffset_ = 0;
+}
+
 /* This method makes the array reference another, but it does it as a
    "weak" reference that is not counted. If you can guarantee that the
    array memory block containing the data is persistent, this will 
@@ -369,6 +369,43 @@ Array<P_numtype, N_rank>::operator<<=(BZ_ETPARM(_bz_ArrayExpr<T_expr>) expr)
 
 #endif // BZ_NEW_EXPRESSION_TEMPLATES
 
+/*
+ * Move assignment.  If this array and x are the only references to their
+ * memory (or this array is empty, or x is the single owner of its memory),
+ * nobody can tell the memory of x from a copy of its elements, so this
+ * array takes it, with the shape and storage of x, and x gets the old
+ * memory.  Otherwise the elements are
+ * copied as usual, so the views of this array see them.  For the copy,
+ * an array nobody else sees takes the shape of x first, as it would with
+ * its memory; an array with views must have the shape of x already.
+ */
+template<typename P_numtype, int N_rank>
+inline Array<P_numtype, N_rank>&
+Array<P_numtype, N_rank>::operator=(Array<T_numtype,N_rank>&& x)
+{
+    const bool thisIsFree = T_base::isOnlyReference() || (numElements() == 0);
+    const bool xIsFree = x.isOnlyReference() || x.isOwner();
+    if ((this == &x) || !thisIsFree || !xIsFree)
+    {
+        if ((this != &x) && thisIsFree &&
+            !areShapesConformable(shape(), x.shape()))
+            resize(x.shape());
+        BZPRECHECK(areShapesConformable(shape(), x.shape()),
+            "Moved an array of shape " << x.shape()
+            << " into an array of shape " << shape()
+            << " that has other references");
+        const T_array& source = x;
+        return (*this) = source;
+    }
+
+    std::swap(storage_, x.storage_);
+    std::swap(length_, x.length_);
+    std::swap(stride_, x.stride_);
+    std::swap(zeroOffset_, x.zeroOffset_);
+    T_base::swapBlock(x);
+    return *this;
+}
+
 BZ_NAMESPACE_END
 
 #endif // BZ_ARRAYOPS_CC
@@ -15,6 +15,16 @@ BZ_NAMESPACE(blitz)
 template<typename P_type>
 void MemoryBlock<P_type>::deallocate()
 {
+    if (tag_ >= 0) {
+        memoryAccounts()[tag_].remove(length_ * sizeof(T_type));
+        memoryAccounts()[memoryTagCount].remove(length_ * sizeof(T_type));
+    }
+
+    if (allocator_) {
+        allocator_->deallocate(dataBlockAddress_, length_ * sizeof(T_type));
+        return;
+    }
+
 #ifndef BZ_ALIGN_BLOCKS_ON_CACHELINE_BOUNDARY
     delete [] dataBlockAddress_;
 #else
@@ -36,6 +46,15 @@ inline void MemoryBlock<P_type>::allocate(size_t length)
         + CT(P_type) + "]");
     TAU_PROFILE(p1, "void ()", TAU_BLITZ);
 
+    allocator_ = NumericTypeTraits<T_type>::hasTrivialCtor ? 
+        memoryBlockAllocator() : 0;
+    if (allocator_) {
+        dataBlockAddress_ = static_cast<T_type*>(
+            allocator_->allocate(length * sizeof(T_type)));
+        data_ = dataBlockAddress_;
+        return;
+    }
+
 #ifndef BZ_ALIGN_BLOCKS_ON_CACHELINE_BOUNDARY
     dataBlockAddress_ = new T_type[length];
     data_ = dataBlockAddress_;
@@ -30,6 +30,7 @@
 #include <blitz/blitz.h>
 
 #include <stddef.h>     // ptrdiff_t
+#include <atomic>
 
 BZ_NAMESPACE(blitz)
 
@@ -42,10 +43,143 @@ enum preexistingMemoryPolicy {
 // Forward declaration of MemoryBlockReference
 template<typename T_type> class MemoryBlockReference;
 
+// Class MemoryBlockAllocator lets the program provide the memory of the
+// blocks (e.g. from a pool) instead of new[] and delete[].  Only blocks
+// of types with a trivial constructor use it.  Each block remembers the
+// allocator it came from, so the allocator can be changed at any time,
+// but it must outlive the blocks it allocated.
+class MemoryBlockAllocator {
+public:
+    virtual ~MemoryBlockAllocator()
+    { }
+
+    // Returns memory for at least bytes bytes, aligned for any type
+    virtual void* allocate(size_t bytes) = 0;
+
+    // Gives back the memory returned by allocate(bytes)
+    virtual void deallocate(void* data, size_t bytes) = 0;
+};
+
+inline MemoryBlockAllocator*& memoryBlockAllocatorInstance()
+{
+    static MemoryBlockAllocator* allocator = 0;
+    return allocator;
+}
+
+// The allocator used by the new blocks, 0 for new[] and delete[]
+inline MemoryBlockAllocator* memoryBlockAllocator()
+{
+    return memoryBlockAllocatorInstance();
+}
+
+// Installs an allocator for the new blocks and returns the previous one.
+// Don't call it while other threads are creating arrays.
+inline MemoryBlockAllocator* setMemoryBlockAllocator(
+    MemoryBlockAllocator* allocator)
+{
+    MemoryBlockAllocator* previous = memoryBlockAllocatorInstance();
+    memoryBlockAllocatorInstance() = allocator;
+    return previous;
+}
+
+// Class MemoryAccount keeps the bytes of the blocks alive, and their
+// peak, for the memory accounting.  It can be updated from any thread.
+class MemoryAccount {
+public:
+    MemoryAccount()
+        : bytes_(0), peakBytes_(0)
+    { }
+
+    void add(size_t bytes)
+    {
+        size_t now = bytes_.fetch_add(bytes, std::memory_order_relaxed) 
+            + bytes;
+        size_t peak = peakBytes_.load(std::memory_order_relaxed);
+        while (now > peak && !peakBytes_.compare_exchange_weak(peak, now,
+            std::memory_order_relaxed))
+        { }
+    }
+
+    void remove(size_t bytes)
+    {
+        bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    size_t bytes() const
+    {
+        return bytes_.load(std::memory_order_relaxed);
+    }
+
+    size_t peakBytes() const
+    {
+        return peakBytes_.load(std::memory_order_relaxed);
+    }
+
+    // Starts a new peak from the bytes alive now
+    void resetPeak()
+    {
+        peakBytes_.store(bytes(), std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<size_t> bytes_;
+    std::atomic<size_t> peakBytes_;
+};
+
+// The memory of the blocks is accounted by tag, so the program can tell
+// what its memory goes to.  A block takes the tag of the thread that
+// allocates it (see MemoryTagScope); the tag of a thread is 0 until it
+// is set.  Only the blocks Blitz++ allocates itself are accounted, not
+// those made around preexisting memory.
+const int memoryTagCount = 8;
+
+// The accounts of the tags, and one more with the total of all of them
+inline MemoryAccount* memoryAccounts()
+{
+    static MemoryAccount accounts[memoryTagCount + 1];
+    return accounts;
+}
+
+inline int& currentMemoryTag()
+{
+    static thread_local int tag = 0;
+    return tag;
+}
+
+// Class MemoryTagScope sets the tag of the blocks allocated by this
+// thread while it is alive
+class MemoryTagScope {
+public:
+    explicit MemoryTagScope(int tag)
+        : previous_(currentMemoryTag())
+    {
+        BZPRECONDITION((tag >= 0) && (tag < memoryTagCount));
+        currentMemoryTag() = tag;
+    }
+
+    ~MemoryTagScope()
+    {
+        currentMemoryTag() = previous_;
+    }
+
+private:
+    int previous_;
+
+    MemoryTagScope(const MemoryTagScope&);
+    void operator=(const MemoryTagScope&);
+};
+
 // Class MemoryBlock provides a reference-counted block of memory.  This block
 // may be referred to by multiple vector, matrix and array objects.  The memory
 // is automatically deallocated when the last referring object is destructed.
 // MemoryBlock may be subclassed to provide special allocators.
+//
+// The reference count is a std::atomic, updated without locks, so arrays
+// can be copied and sliced from any thread.  A block used by one thread
+// only can count with plain loads and stores instead (see doLock() and
+// Array::threadLocal()).  A block can also have a single owner (see
+// setOwner() and Array::singleOwner()): then the other references don't
+// count at all, and the block goes with its owner.
 template<typename P_type>
 class MemoryBlock {
 
@@ -60,10 +194,11 @@ protected:
         length_ = 0;
         data_ = 0;
         dataBlockAddress_ = 0;
+        allocator_ = 0;
+        tag_ = -1;
         references_ = 0;
-
-        BZ_MUTEX_INIT(mutex)
-        mutexLocking_ = true;    
+        owner_ = 0;
+        atomicCounting_ = true;
     }
 
     explicit MemoryBlock(size_t items)
@@ -71,6 +206,10 @@ protected:
         length_ = items;
         allocate(length_);
 
+        tag_ = currentMemoryTag();
+        memoryAccounts()[tag_].add(length_ * sizeof(T_type));
+        memoryAccounts()[memoryTagCount].add(length_ * sizeof(T_type));
+
 #ifdef BZ_DEBUG_LOG_ALLOCATIONS
     cout << "MemoryBlock: allocated " << setw(8) << length_ 
          << " at " << ((void *)dataBlockAddress_) << endl;
@@ -79,9 +218,8 @@ protected:
         BZASSERT(dataBlockAddress_ != 0);
 
         references_ = 0;
-
-        BZ_MUTEX_INIT(mutex)
-        mutexLocking_ = true;    
+        owner_ = 0;
+        atomicCounting_ = true;
     }
 
     MemoryBlock(size_t length, T_type* data)
@@ -89,9 +227,11 @@ protected:
         length_ = length;
         data_ = data;
         dataBlockAddress_ = data;
+        allocator_ = 0;
+        tag_ = -1;
         references_ = 0;
-        BZ_MUTEX_INIT(mutex)
-        mutexLocking_ = true;    
+        owner_ = 0;
+        atomicCounting_ = true;
     }
 
     virtual ~MemoryBlock()
@@ -106,38 +246,66 @@ protected:
 
             deallocate();
         }
-
-        BZ_MUTEX_DESTROY(mutex)
     }
 
-    // set mutex locking policy and return true if successful
+    // set the counting policy (atomic if lockingPolicy is true, plain
+    // loads and stores if false) and return true if successful
     bool doLock(bool lockingPolicy) 
     { 
-        if (mutexLocking_ == lockingPolicy) { // already set
+        if (atomicCounting_ == lockingPolicy) { // already set
             return true;
         }
-        else if (references_ <= 1) { // no multiple references, safe to change
-            mutexLocking_ = lockingPolicy; 
+        else if (references_.load(std::memory_order_relaxed) <= 1) { 
+            // no multiple references, safe to change
+            atomicCounting_ = lockingPolicy; 
             return true;
         }
         return false; // unsafe to change
     }
 
+    // make owner the only reference that counts and return true if
+    // successful.  It is only safe with a single reference to the block
+    bool setOwner(const void* owner)
+    {
+        if (owner_ == owner) { // already set
+            return true;
+        }
+        else if (!owner_ && references_.load(std::memory_order_relaxed) == 1) {
+            owner_ = owner;
+            return true;
+        }
+        return false; // unsafe to change
+    }
+
+    // hand the block from its owner to another reference, when a
+    // reference takes the block of another one (see swapBlock())
+    void moveOwner(const void* from, const void* to)
+    {
+        if (owner_ && owner_ == from)
+            owner_ = to;
+    }
+
+    // the owner of the block, 0 if all the references count
+    const void*   owner() const
+    {
+        return owner_;
+    }
+
     void          addReference()
     { 
-        if (mutexLocking_) {
-            BZ_MUTEX_LOCK(mutex)
+        if (atomicCounting_) {
+            references_.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            references_.store(references_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
         }
-        ++references_; 
 
 #ifdef BZ_DEBUG_LOG_REFERENCES
     cout << "MemoryBlock:    reffed " << setw(8) << length_ 
          << " at " << ((void *)dataBlockAddress_) << " (r=" 
          << (int)references_ << ")" << endl;
 #endif
-        if (mutexLocking_) {
-            BZ_MUTEX_UNLOCK(mutex)
-        }
     }
 
     T_type* restrict      data() 
@@ -162,34 +330,29 @@ protected:
 
     int           removeReference()
     {
-
-        if (mutexLocking_) {
-            BZ_MUTEX_LOCK(mutex)
+        // the thread that drops the last reference must see all the
+        // writes of the others before it deletes the block
+        int refcount;
+        if (atomicCounting_) {
+            refcount = T_count(references_.fetch_sub(1, 
+                std::memory_order_acq_rel) - 1);
+        }
+        else {
+            refcount = T_count(references_.load(std::memory_order_relaxed) - 1);
+            references_.store(refcount, std::memory_order_relaxed);
         }
-        int refcount = --references_;
 
 #ifdef BZ_DEBUG_LOG_REFERENCES
     cout << "MemoryBlock: dereffed  " << setw(8) << length_
          << " at " << ((void *)dataBlockAddress_) << " (r=" << (int)references_ 
          << ")" << endl;
 #endif
-        if (mutexLocking_) {
-            BZ_MUTEX_UNLOCK(mutex)
-        }
         return refcount;
     }
 
     int references() const
     {
-        if (mutexLocking_) {
-            BZ_MUTEX_LOCK(mutex)
-        }
-        int refcount = references_;
-        if (mutexLocking_) {
-            BZ_MUTEX_UNLOCK(mutex)
-        }
-
-        return refcount;
+        return references_.load(std::memory_order_relaxed);
     }
 
 protected:
@@ -206,15 +369,19 @@ private:   // Disabled member functions
 private:   // Data members
     T_type * restrict     data_;
     T_type *              dataBlockAddress_;
+    MemoryBlockAllocator* allocator_;
+    // the memory tag of the block, -1 if it is not accounted
+    int                   tag_;
 
 #ifdef BZ_DEBUG_REFERENCE_ROLLOVER
-    volatile unsigned char references_;
+    typedef unsigned char T_count;
 #else
-    volatile int references_;
+    typedef int T_count;
 #endif
+    std::atomic<T_count>  references_;
 
-    BZ_MUTEX_DECLARE(mutex)
-    bool    mutexLocking_;
+    const void* owner_;
+    bool    atomicCounting_;
     size_t  length_;
 };
 
@@ -315,6 +482,42 @@ protected:
         return true;    
     }
 
+    // true if this is the only reference to its block that counts, so
+    // nobody else sees the data
+    bool isOnlyReference() const
+    {
+        return block_ && !block_->owner() && (block_->references() == 1);
+    }
+
+    // true if this is the single owner of its block (see ownBlock())
+    bool isOwner() const
+    {
+        return block_ && (block_->owner() == this);
+    }
+
+    void swapBlock(MemoryBlockReference<T_type>& ref)
+    {
+        MemoryBlock<T_type>* block = block_;
+        block_ = ref.block_;
+        ref.block_ = block;
+        T_type* data = data_;
+        data_ = ref.data_;
+        ref.data_ = data;
+        // a single owner goes with its block
+        if (block_)
+            block_->moveOwner(&ref, this);
+        if (ref.block_)
+            ref.block_->moveOwner(this, &ref);
+    }
+
+    bool ownBlock() const
+    {
+        if (block_)
+            return block_->setOwner(this);
+        // if we have no block, there is nothing to own
+        return true;
+    }
+
     void changeToNullBlock()
     {
         blockRemoveReference();
@@ -361,7 +564,7 @@ private:
 
     void addReference() const 
     {
-        if (block_) {
+        if (block_ && !block_->owner()) {
             block_->addReference();
         }
         else {
@@ -373,6 +576,9 @@ private:
 
     int removeReference() const 
     {
+        // with a single owner, only the owner removes the block
+        if (block_ && block_->owner())
+            return (block_->owner() == this) ? 0 : -1;
         if (block_)
             return block_->removeReference();
 #ifdef BZ_DEBUG_LOG_REFERENCES
@@ -12,8 +12,9 @@
 #ifndef BLOCK_H 
 #define BLOCK_H
 
-#include <fstream>
 #include "blitz/array.h"
+#include "blockFile.h"
+#include "blockStore.h"
 
 ///Block class
 class Block {
@@ -24,64 +25,74 @@ class Block {
 		blitz::Array<double,2> blockH;   
 
 		Block();
+		Block(BlockStore& store);
 		void ISAwrite(const int sites);
 		void FSAread(const int sites,const int iter);
 		void FSAwrite(const int sites,const int iter);
+		void FSAprefetch(const int sites,const int iter);
+		void ISAwriteTransformation(const int sites,
+			const blitz::Array<double,2>& OO);
+		void FSAwriteTransformation(const int sites,const int iter,
+			const blitz::Array<double,2>& OO);
+		void exportText(const char* textFileName) const;
 
 	private:
-	    ///filename for storing block on disk
-		char fname[7];
-
-		void Read();
-		void Write();
+	    ///where the blocks are saved
+		BlockStore* store;
+	    ///the mapped block blockH uses, if any
+		BlockMapping mapping;
 };
 Block::Block(){
-///constructor: initialize filename for writing blocks to file
-  fname[0] = '.'; fname[1] = 48;  //ASCII for 0
-  fname[4] = '.'; fname[5] = 'r'; 
-  fname[6] = '\0';
+///constructor: the blocks are saved in the default store
+  store = &defaultBlockStore();
+}
+
+Block::Block(BlockStore& blockStore){
+///constructor: same as above, saving the blocks in blockStore
+  store = &blockStore;
 }
 
 void Block::ISAwrite(const int sites){
-/// rename/write wrapper for the ISA
-	fname[3] = 48 + (sites)%10;          //some ASCII 
-	fname[2] = 48 + sites/10;
-	fname[5] = 'l';
-	Write(); //write left block
-	fname[5] = 'r'; 
-	Write(); //write right block
+/// write wrapper for the ISA: saves the block as left and right block
+	store->put(BlockKey(sites, 'l', -1), blockH);
+	store->put(BlockKey(sites, 'r', -1), blockH);
 }
 
 void Block::FSAread(const int sites,const int iter){
-/// file read for the finite-system algorithm
-	fname[3] = 48 + (sites)%10;          //some ASCII 
-	fname[2] = 48 + sites/10;
-	if (iter%2 == 0) fname[5] = 'r';  else fname[5]= 'l';
-	Read();
+/// block read for the finite-system algorithm
+	char side = (iter%2 == 0)? 'r' : 'l';
+	store->get(sites, side, blockH, mapping);
 }//FSAread
 
+void Block::FSAprefetch(const int sites,const int iter){
+/// starts loading in the background the block FSAread(sites,iter) reads
+	char side = (iter%2 == 0)? 'r' : 'l';
+	store->prefetch(sites, side);
+}//FSAprefetch
+
 void Block::FSAwrite(const int sites,const int iter){
-/// file write for the finite-system algorithm
-      fname[3] = 48 + (sites)%10;         //some ASCII 
-      fname[2] = 48 + sites/10;
-      if (iter%2 == 0) fname[5] = 'l';  else fname[5]= 'r';
-      Write();
+/// block write for the finite-system algorithm
+	char side = (iter%2 == 0)? 'l' : 'r';
+	store->put(BlockKey(sites, side, iter), blockH);
 }//FSAwrite
 
-void Block::Write() {
-/// opens the output file and writes the Blitz++ array
-  std::ofstream fout;  
-  fout.open(fname,std::ios::out);
-  fout <<std::setprecision(12)<<blockH ;
-  fout.close();
-} //Write
+void Block::ISAwriteTransformation(const int sites,
+	const blitz::Array<double,2>& OO){
+/// saves the truncation matrix of the block of sites sites for both sides
+	store->putTransformation(BlockKey(sites, 'l', -1), OO);
+	store->putTransformation(BlockKey(sites, 'r', -1), OO);
+}
+
+void Block::FSAwriteTransformation(const int sites,const int iter,
+	const blitz::Array<double,2>& OO){
+/// saves the truncation matrix of the block of sites sites in the FSA
+	char side = (iter%2 == 0)? 'l' : 'r';
+	store->putTransformation(BlockKey(sites, side, iter), OO);
+}
 
-void Block::Read() {
-/// opens the input file and reads the Blitz++ array
-  std::ifstream fin;  
-  fin.open(fname,std::ios::in);
-  fin >> blockH ;
-  fin.close();
-}//Read
+void Block::exportText(const char* textFileName) const {
+/// writes the Blitz++ array as text, e.g. to look at it
+  exportBlockMatrixText(textFileName, blockH);
+}//exportText
 
 #endif
@@ -0,0 +1,513 @@
+/**
+ * @file blockArchive.cpp
+ *
+ * @brief Implementation of the single file archive for the blocks
+ *
+ * @author Roger Melko 
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$ 
+ */
+#include <chrono>
+#include <climits>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "blitz/array.h"
+#include "exceptions.h"
+#include "blockFile.h"
+#include "blockArchive.h"
+
+namespace {
+
+/// a clock for the compression statistics
+double secondsNow()
+{
+    return std::chrono::duration<double>(
+	    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// writes all the bytes, or throws
+void writeAll(int fd, const void* data, size_t length, off_t offset,
+	const std::string& what)
+{
+    const char* p=static_cast<const char*>(data);
+    while (length>0)
+    {
+	ssize_t n=pwrite(fd, p, length, offset);
+	if (n<=0)
+	    throw dmrg::Exception("BlockArchive: can't write "+what);
+	p+=n; length-=n; offset+=n;
+    }
+}
+
+/// reads all the bytes, or throws
+void readAll(int fd, void* data, size_t length, off_t offset,
+	const std::string& what)
+{
+    char* p=static_cast<char*>(data);
+    while (length>0)
+    {
+	ssize_t n=pread(fd, p, length, offset);
+	if (n<=0)
+	    throw dmrg::Exception("BlockArchive: can't read "+what);
+	p+=n; length-=n; offset+=n;
+    }
+}
+
+}
+
+/**
+ * @brief Constructor: creates the archive empty
+ *
+ * @param fileName the name of the archive file. Any file with this name
+ * is replaced
+ */
+BlockArchive::BlockArchive(const std::string& fileName)
+    : archiveFileName(fileName), fd(-1), end(0)
+{
+    const long pageSize=sysconf(_SC_PAGESIZE);
+    alignment=pageSize>4096? pageSize : 4096;
+
+    fd=open(fileName.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if (fd<0)
+	throw dmrg::Exception("BlockArchive: can't open "+fileName);
+}
+
+/**
+ * @brief Constructor: opens an archive with a given index
+ *
+ * @param fileName the name of the archive file
+ * @param index the records in the archive, as returned by snapshot()
+ *
+ * The records are kept on disk until the next snapshot, as with
+ * snapshot(). Anything written to the archive after the snapshot is
+ * ignored. The data of the records is checked when they are first read
+ * or mapped.
+ */
+BlockArchive::BlockArchive(const std::string& fileName, 
+	const std::vector<Record>& index)
+    : archiveFileName(fileName), fd(-1), end(0)
+{
+    const long pageSize=sysconf(_SC_PAGESIZE);
+    alignment=pageSize>4096? pageSize : 4096;
+
+    fd=open(fileName.c_str(), O_RDWR);
+    if (fd<0)
+	throw dmrg::Exception("BlockArchive: can't open "+fileName);
+    struct stat st;
+    try
+    {
+	if (fstat(fd, &st)!=0)
+	    throw dmrg::Exception("BlockArchive: can't open "+fileName);
+	// the last record may end in a partial page
+	useIndex(index, (st.st_size+alignment-1)/alignment*alignment);
+    }
+    catch (dmrg::Exception&)
+    {
+	close(fd);
+	throw;
+    }
+    for (size_t i=0; i<index.size(); i++)
+    {
+	preserved.insert(index[i].offset);
+	unverified.insert(index[i].offset);
+    }
+}
+
+/**
+ * @brief Destructor: closes the file
+ */
+BlockArchive::~BlockArchive()
+{
+    close(fd);
+}
+
+/**
+ * @brief A function to get the index of the archive, to save it
+ *
+ * @return the records in the archive
+ *
+ * Flushes the archive to disk, and keeps the space of the records on
+ * disk until the next snapshot, even if they are released, so the
+ * archive can be opened with this index (see BlockArchive(fileName,
+ * index)) until then. Make sure all the records have been written
+ * before, and save the index before writing more blocks.
+ */
+std::vector<BlockArchive::Record> BlockArchive::snapshot()
+{
+    std::lock_guard<std::mutex> lock(archiveMutex);
+    if (fsync(fd)!=0)
+	throw dmrg::Exception("BlockArchive: can't sync "+archiveFileName);
+
+    std::map<off_t, size_t>::const_iterator space;
+    for (space=preservedSpace.begin(); space!=preservedSpace.end(); ++space)
+	addFreeSpace(space->first, space->second);
+    preservedSpace.clear();
+    preserved.clear();
+
+    std::vector<Record> index;
+    std::map<BlockKey, Record>::const_iterator it;
+    for (it=records.begin(); it!=records.end(); ++it)
+    {
+	index.push_back(it->second);
+	preserved.insert(it->second.offset);
+    }
+    return index;
+}
+
+/**
+ * @brief A function to write a block
+ *
+ * @param key the block. It replaces any block with the same key
+ * @param matrix the block Hamiltonian
+ * @param compression if enabled, the block is compressed before writing
+ * it (see compressBlock())
+ *
+ * @return where the block was written
+ */
+BlockArchive::Record BlockArchive::write(const BlockKey& key, 
+	const blitz::Array<double,2>& matrix, 
+	const BlockCompression& compression)
+{
+    blitz::Array<double,2> data=contiguousBlockMatrix(matrix);
+    const size_t n=data.numElements();
+    BlockFileHeader header=makeBlockFileHeader(data);
+    header.sites=key.sites;
+    header.side=key.side;
+    header.sweep=key.sweep;
+
+    std::vector<char> compressed;
+    if (compression.enabled)
+    {
+	const double start=secondsNow();
+	if (compression.threshold>0.0)
+	{
+	    // the checksum is for the elements that are really stored
+	    blitz::Array<double,2> dropped(data.shape());
+	    dropped=blitz::where(blitz::abs(data)<compression.threshold, 
+		    0.0, data);
+	    data.reference(dropped);
+	    header.checksum=blockChecksum(data.data(), n);
+	}
+	compressBlock(data.data(), n, compressed);
+	header.codec=BLOCK_CODEC_SHUFFLE_LZ;
+	header.storedBytes=compressed.size();
+
+	std::lock_guard<std::mutex> lock(archiveMutex);
+	statistics.compressSeconds+=secondsNow()-start;
+	statistics.rawBytes+=n*sizeof(double);
+	statistics.storedBytes+=compressed.size();
+    }
+
+    Record record=allocate(key, header.rows, header.cols, header.storedBytes,
+	    header.codec);
+    const std::string what=recordName(key);
+    writeAll(fd, &header, sizeof(header), record.offset, what);
+    writeAll(fd, compression.enabled? compressed.data() : 
+	    reinterpret_cast<const char*>(data.data()), header.storedBytes, 
+	    record.offset+sizeof(header), what);
+    return record;
+}
+
+/**
+ * @brief Reserves space for a block and puts it in the index
+ *
+ * Uses the first free space big enough that is not mapped any more, or
+ * appends the record at the end of the file.
+ */
+BlockArchive::Record BlockArchive::allocate(const BlockKey& key, 
+	int rows, int cols, size_t storedBytes, uint32_t codec)
+{
+    Record record;
+    record.key=key;
+    record.rows=rows;
+    record.cols=cols;
+    record.codec=codec;
+    const size_t length=sizeof(BlockFileHeader)+storedBytes;
+    record.capacity=(length+alignment-1)/alignment*alignment;
+
+    std::lock_guard<std::mutex> lock(archiveMutex);
+    std::map<BlockKey, Record>::iterator old=records.find(key);
+    if (old!=records.end())
+	releaseSpace(old->second);
+
+    std::map<off_t, size_t>::iterator it;
+    for (it=freeSpace.begin(); it!=freeSpace.end(); ++it)
+	if (it->second>=record.capacity && 
+		!isMapped(it->first, record.capacity))
+	    break;
+
+    if (it!=freeSpace.end())
+    {
+	record.offset=it->first;
+	const size_t left=it->second-record.capacity;
+	freeSpace.erase(it);
+	if (left>0)
+	    freeSpace[record.offset+record.capacity]=left;
+    }
+    else
+    {
+	record.offset=end;
+	end+=record.capacity;
+    }
+
+    records[key]=record;
+    return record;
+}
+
+/**
+ * @brief A function to find the last version of a block
+ *
+ * @param sites number of sites of the block
+ * @param side 'l' or 'r'
+ * @param record on return, where the block is
+ *
+ * @return false if there is no such block in the archive
+ */
+bool BlockArchive::find(int sites, char side, Record& record) const
+{
+    std::lock_guard<std::mutex> lock(archiveMutex);
+    std::map<BlockKey, Record>::const_iterator it=
+	records.upper_bound(BlockKey(sites, side, INT_MAX));
+    if (it==records.begin())
+	return false;
+    --it;
+    if (it->first.sites!=sites || it->first.side!=side)
+	return false;
+    record=it->second;
+    return true;
+}
+
+/**
+ * @brief A function to remove a block from the archive
+ *
+ * Its space is reused by allocate() once nobody maps it any more.
+ */
+void BlockArchive::release(const Record& record)
+{
+    std::lock_guard<std::mutex> lock(archiveMutex);
+    std::map<BlockKey, Record>::iterator it=records.find(record.key);
+    if (it!=records.end() && it->second.offset==record.offset)
+	releaseSpace(it->second);
+}
+
+/**
+ * @brief Removes a record from the index and adds its space to the free
+ * space
+ *
+ * The space of the records in the last snapshot is kept until the next
+ * snapshot.
+ */
+void BlockArchive::releaseSpace(Record record)
+{
+    records.erase(record.key);
+    unverified.erase(record.offset);
+    if (preserved.count(record.offset))
+	preservedSpace[record.offset]=record.capacity;
+    else
+	addFreeSpace(record.offset, record.capacity);
+}
+
+/**
+ * @brief Adds space to the free space, merging it with its neighbours
+ */
+void BlockArchive::addFreeSpace(off_t offset, size_t length)
+{
+    // merge with the free space around it
+    std::map<off_t, size_t>::iterator next=freeSpace.lower_bound(offset);
+    if (next!=freeSpace.begin())
+    {
+	std::map<off_t, size_t>::iterator previous=next;
+	--previous;
+	if (previous->first+off_t(previous->second)==offset)
+	{
+	    offset=previous->first;
+	    length+=previous->second;
+	    freeSpace.erase(previous);
+	}
+    }
+    if (next!=freeSpace.end() && offset+off_t(length)==next->first)
+    {
+	length+=next->second;
+	freeSpace.erase(next);
+    }
+    freeSpace[offset]=length;
+}
+
+/**
+ * @brief A function to read a block
+ *
+ * @param record where the block is
+ * @param matrix the matrix to read into. It is resized if needed
+ *
+ * Compressed blocks are decompressed.
+ * Checks the header and the checksum, and throws a dmrg::Exception if
+ * the record is not valid.
+ */
+void BlockArchive::readRecord(const Record& record,
+	blitz::Array<double,2>& matrix)
+{
+    const std::string what=recordName(record.key);
+    BlockFileHeader header;
+    readAll(fd, &header, sizeof(header), record.offset, what);
+    checkBlockFileHeader(header, record.capacity, what);
+    if (header.rows!=record.rows || header.cols!=record.cols)
+	throw dmrg::Exception("BlockArchive: wrong shape for "+what);
+
+    matrix.resize(header.rows, header.cols);
+    if (matrix.stride(blitz::secondDim)!=1 || 
+	    matrix.stride(blitz::firstDim)!=matrix.cols())
+	matrix.reference(blitz::Array<double,2>(header.rows, header.cols));
+
+    const size_t n=matrix.numElements();
+    if (header.codec==BLOCK_CODEC_NONE)
+	readAll(fd, matrix.data(), n*sizeof(double), 
+		record.offset+sizeof(header), what);
+    else
+    {
+	std::vector<char> compressed(header.storedBytes);
+	readAll(fd, compressed.data(), compressed.size(), 
+		record.offset+sizeof(header), what);
+	const double start=secondsNow();
+	decompressBlock(compressed.data(), compressed.size(), matrix.data(), n);
+
+	std::lock_guard<std::mutex> lock(archiveMutex);
+	statistics.decompressSeconds+=secondsNow()-start;
+	statistics.decompressedBytes+=n*sizeof(double);
+    }
+    if (blockChecksum(matrix.data(), n)!=header.checksum)
+	throw dmrg::Exception("BlockArchive: corrupted block "+what);
+}
+
+/**
+ * @brief A function to map a block in memory
+ *
+ * @param record where the block is
+ *
+ * @return the mapped block (see MappedBlockFile.) Its space in the
+ * archive is not reused while the mapping is alive.
+ *
+ * Only the header is checked, except the first time a block written
+ * before a snapshot (see BlockArchive(fileName, index)) is mapped: then
+ * its checksum is checked too, as readRecord() always does.
+ *
+ * Throws a dmrg::Exception if the block is compressed.
+ */
+BlockMapping BlockArchive::mapRecord(const Record& record)
+{
+    const std::string what=recordName(record.key);
+    BlockMapping mapping(new MappedBlockFile(fd, record.offset,
+		record.capacity, what));
+    bool check;
+    {
+	std::lock_guard<std::mutex> lock(archiveMutex);
+	check=unverified.count(record.offset)>0;
+    }
+    if (check)
+	mapping->verify(what);
+
+    std::lock_guard<std::mutex> lock(archiveMutex);
+    unverified.erase(record.offset);
+    mappings.push_back(mapping);
+    return mapping;
+}
+
+/**
+ * @brief A function to get the size of the archive file in bytes, not
+ * counting the index
+ */
+off_t BlockArchive::size() const
+{
+    std::lock_guard<std::mutex> lock(archiveMutex);
+    return end;
+}
+
+/**
+ * @brief A function to get how much compression has saved and cost so far
+ */
+BlockArchive::CompressionStatistics BlockArchive::compressionStatistics() const
+{
+    std::lock_guard<std::mutex> lock(archiveMutex);
+    return statistics;
+}
+
+/**
+ * @brief Checks if part of the file is used by a live mapping
+ *
+ * Forgets the mappings that are gone. Call it with archiveMutex locked.
+ */
+bool BlockArchive::isMapped(off_t offset, size_t length)
+{
+    bool mapped=false;
+    std::list<std::weak_ptr<MappedBlockFile> >::iterator it=mappings.begin();
+    while (it!=mappings.end())
+    {
+	BlockMapping mapping=it->lock();
+	if (!mapping)
+	{
+	    mappings.erase(it++);
+	    continue;
+	}
+	if (mapping->offset()<offset+off_t(length) && 
+		offset<mapping->offset()+off_t(mapping->length()))
+	    mapped=true;
+	++it;
+    }
+    return mapped;
+}
+
+/**
+ * @brief Puts the records of an index in the archive
+ *
+ * @param index the records
+ * @param fileEnd where the data of the file ends. The records must be
+ * before it
+ *
+ * The space between the records is added to the free space.
+ */
+void BlockArchive::useIndex(const std::vector<Record>& index, off_t fileEnd)
+{
+    end=0;
+    std::map<off_t, size_t> used;
+    for (size_t i=0; i<index.size(); i++)
+    {
+	const Record& record=index[i];
+	const off_t recordEnd=record.offset+off_t(record.capacity);
+	if (record.offset<0 || record.offset%alignment!=0 || record.capacity%alignment!=0 ||
+		recordEnd>fileEnd || used.count(record.offset))
+	    throw dmrg::Exception("BlockArchive: corrupted index in "+
+		    archiveFileName);
+	records[record.key]=record;
+	used[record.offset]=record.capacity;
+	if (recordEnd>end)
+	    end=recordEnd;
+    }
+
+    off_t position=0;
+    std::map<off_t, size_t>::const_iterator it;
+    for (it=used.begin(); it!=used.end(); ++it)
+    {
+	if (it->first>position)
+	    freeSpace[position]=it->first-position;
+	position=it->first+it->second;
+    }
+}
+
+/**
+ * @brief The name of a block for the error messages
+ */
+std::string BlockArchive::recordName(const BlockKey& key) const
+{
+    std::ostringstream name;
+    name<<archiveFileName<<'['<<key.sites<<key.side;
+    if (key.sweep>=0)
+	name<<", sweep "<<key.sweep;
+    name<<']';
+    return name.str();
+}
+// end blockArchive.cpp
@@ -0,0 +1,173 @@
+/**
+ * @file blockArchive.h
+ *
+ * @brief A class that stores all the blocks of a run in a single file
+ *
+ * @author Roger Melko 
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$ 
+ */
+#ifndef BLOCK_ARCHIVE_H
+#define BLOCK_ARCHIVE_H
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "blitz/array.h"
+#include "blockCodec.h"
+#include "blockFile.h"
+
+/**
+ * @brief The name of a block in the archive
+ *
+ * Blocks are identified by their number of sites, their side ('l' or
+ * 'r', or 'L' and 'R' for their truncation matrices) and the half sweep
+ * in which they were written (-1 for the infinite system algorithm.)
+ */
+struct BlockKey
+{
+    /// number of sites of the block
+    int sites;
+    /// 'l' or 'r' ('L' or 'R' for truncation matrices)
+    char side;
+    /// half sweep in which the block was written
+    int sweep;
+
+    BlockKey(int sites=0, char side='l', int sweep=-1) 
+	: sites(sites), side(side), sweep(sweep) {}
+    bool operator<(const BlockKey& other) const
+    {
+	if (sites!=other.sites) return sites<other.sites;
+	if (side!=other.side) return side<other.side;
+	return sweep<other.sweep;
+    }
+};
+
+/**
+ * @brief A single file holding the blocks of a run
+ *
+ * Each block is a record: a BlockFileHeader followed by the matrix, as
+ * in a block file, starting at an offset aligned to the page size so it
+ * can be mapped. Records are appended at the end of the file, or put in
+ * the space freed by a released record when it fits. An index keyed by
+ * (sites, side, sweep) gives the offset of each record, so any block can
+ * be read (or mapped) directly.
+ *
+ * Blocks can be compressed when they are written (see compressBlock()).
+ * Compressed records take less space but can't be mapped, only read.
+ *
+ * The index is not kept in the file: snapshot() gives it, to save it
+ * elsewhere (e.g. in a checkpoint), and keeps the records in it on disk
+ * until the next snapshot. The archive and the saved index can then be
+ * moved together to another disk and opened again with
+ * BlockArchive(fileName, index).
+ *
+ * All the functions can be called from any thread, as long as two
+ * threads don't use the same record at the same time.
+ */
+class BlockArchive {
+    public:
+	/// where a block is stored in the archive
+	struct Record {
+	    /// the block
+	    BlockKey key;
+	    /// where the record (the header) starts in the file
+	    off_t offset;
+	    /// number of rows of the matrix
+	    int rows;
+	    /// number of columns of the matrix
+	    int cols;
+	    /// bytes reserved for the record
+	    size_t capacity;
+	    /// how the block is stored, see blockCodec.h
+	    uint32_t codec;
+
+	    Record() : offset(0), rows(0), cols(0), capacity(0), 
+		codec(BLOCK_CODEC_NONE) {}
+	};
+
+	/// how much compression has saved and cost
+	struct CompressionStatistics {
+	    /// bytes of the blocks compressed
+	    double rawBytes;
+	    /// bytes of the compressed blocks
+	    double storedBytes;
+	    /// seconds spent compressing
+	    double compressSeconds;
+	    /// bytes of the blocks decompressed
+	    double decompressedBytes;
+	    /// seconds spent decompressing
+	    double decompressSeconds;
+
+	    CompressionStatistics() : rawBytes(0), storedBytes(0), 
+		compressSeconds(0), decompressedBytes(0), decompressSeconds(0) {}
+	};
+
+	BlockArchive(const std::string& fileName);
+	BlockArchive(const std::string& fileName, 
+		const std::vector<Record>& index);
+	~BlockArchive();
+
+	Record write(const BlockKey& key, const blitz::Array<double,2>& matrix,
+		const BlockCompression& compression=BlockCompression());
+	bool find(int sites, char side, Record& record) const;
+	void release(const Record& record);
+	std::vector<Record> snapshot();
+
+	void readRecord(const Record& record, 
+		blitz::Array<double,2>& matrix);
+	BlockMapping mapRecord(const Record& record);
+
+	/// the name of the archive file
+	const std::string& fileName() const { return archiveFileName; }
+	off_t size() const;
+	CompressionStatistics compressionStatistics() const;
+
+    private:
+	std::string archiveFileName;
+	int fd;
+	/// where the records must start: a multiple of the page size
+	size_t alignment;
+	/// end of the last record
+	off_t end;
+
+	/// the records in the archive
+	std::map<BlockKey, Record> records;
+	/// space of released records: offset and length
+	std::map<off_t, size_t> freeSpace;
+	/// offsets of the records in the last snapshot
+	std::set<off_t> preserved;
+	/// offsets of the records of the index given to the constructor
+	/// that haven't been mapped yet, whose checksum must be checked
+	std::set<off_t> unverified;
+	/// space of released records of the last snapshot, freed at the next
+	/// one
+	std::map<off_t, size_t> preservedSpace;
+	/// the mappings made by mapRecord(), to know which records are
+	/// still in use
+	std::list<std::weak_ptr<MappedBlockFile> > mappings;
+	CompressionStatistics statistics;
+	/// guards end and everything from records on
+	mutable std::mutex archiveMutex;
+
+	Record allocate(const BlockKey& key, int rows, int cols, 
+		size_t storedBytes, uint32_t codec);
+	void releaseSpace(Record record);
+	void addFreeSpace(off_t offset, size_t length);
+	void useIndex(const std::vector<Record>& index, off_t fileEnd);
+	bool isMapped(off_t offset, size_t length);
+	std::string recordName(const BlockKey& key) const;
+
+	// not copyable
+	BlockArchive(const BlockArchive&);
+	void operator=(const BlockArchive&);
+};
+
+#endif // BLOCK_ARCHIVE_H
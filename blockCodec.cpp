@@ -0,0 +1,310 @@
+/**
+ * @file blockCodec.cpp
+ *
+ * @brief Implementation of the routines that compress the block matrices
+ *
+ * The elements are compressed in chunks of CODEC_CHUNK elements, each
+ * chunk on its own so they can be compressed (and decompressed) in
+ * parallel. Inside a chunk the bytes are shuffled first: all the first
+ * bytes of the elements, then all the second bytes, and so on. The
+ * exponents and the high bytes of the mantissas of neighbouring elements
+ * are very alike, so this puts long repeated runs together, and then a
+ * simple LZ77 coder (in the spirit of LZ4) removes them.
+ *
+ * The compressed block is:
+ * - the number of chunks (uint32)
+ * - the compressed length of each chunk (uint32). A chunk with the same
+ *   length as its shuffled bytes is stored without the LZ coding
+ * - the chunks
+ *
+ * @author Roger Melko 
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$ 
+ */
+#include <cstring>
+#include "exceptions.h"
+#include "blockCodec.h"
+
+namespace {
+
+/// log2 of the size of the hash table of the LZ coder
+const int LZ_HASH_LOG=14;
+/// shortest match the LZ coder looks for
+const size_t LZ_MIN_MATCH=4;
+/// longest distance to a match (offsets are stored in 16 bits)
+const size_t LZ_MAX_OFFSET=65535;
+
+inline uint32_t read32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t hash32(uint32_t value)
+{
+    return (value*2654435761u)>>(32-LZ_HASH_LOG);
+}
+
+/// writes a length that didn't fit in its 4 bits of the token
+void writeLength(size_t length, std::vector<unsigned char>& out)
+{
+    while (length>=255)
+    {
+	out.push_back(255);
+	length-=255;
+    }
+    out.push_back((unsigned char)length);
+}
+
+/// writes the literals in [begin,end) followed by a match
+void writeSequence(const unsigned char* begin, const unsigned char* end,
+	size_t offset, size_t matchLength, std::vector<unsigned char>& out)
+{
+    const size_t literals=end-begin;
+    const size_t match=matchLength? matchLength-LZ_MIN_MATCH : 0;
+    out.push_back((unsigned char)(((literals<15? literals : 15)<<4) |
+		(match<15? match : 15)));
+    if (literals>=15)
+	writeLength(literals-15, out);
+    out.insert(out.end(), begin, end);
+    if (matchLength==0)
+	return;
+    out.push_back((unsigned char)(offset&0xff));
+    out.push_back((unsigned char)(offset>>8));
+    if (match>=15)
+	writeLength(match-15, out);
+}
+
+/**
+ * @brief Compresses bytes with the LZ coder
+ *
+ * Looks for earlier occurrences of the next 4 bytes in a hash table and
+ * extends them as far as they go. When nothing matches for a while it
+ * skips ahead faster, so incompressible data costs little.
+ */
+void compressLZ(const unsigned char* in, size_t n,
+	std::vector<unsigned char>& out)
+{
+    std::vector<int64_t> table(size_t(1)<<LZ_HASH_LOG, -1);
+    size_t anchor=0;
+    size_t i=0;
+    size_t misses=0;
+    while (i+LZ_MIN_MATCH<=n)
+    {
+	const uint32_t sequence=read32(in+i);
+	const uint32_t h=hash32(sequence);
+	const int64_t candidate=table[h];
+	table[h]=i;
+	if (candidate<0 || i-candidate>LZ_MAX_OFFSET || 
+		read32(in+candidate)!=sequence)
+	{
+	    i+=1+(misses++>>6);
+	    continue;
+	}
+
+	size_t length=LZ_MIN_MATCH;
+	while (i+length<n && in[candidate+length]==in[i+length])
+	    length++;
+	writeSequence(in+anchor, in+i, i-candidate, length, out);
+	i+=length;
+	anchor=i;
+	misses=0;
+    }
+    writeSequence(in+anchor, in+n, 0, 0, out);
+}
+
+/// reads a length that didn't fit in its 4 bits of the token
+size_t readLength(const unsigned char*& ip, const unsigned char* end)
+{
+    size_t length=0;
+    unsigned char byte;
+    do
+    {
+	if (ip==end)
+	    throw dmrg::Exception("decompressBlock: corrupted data");
+	byte=*ip++;
+	length+=byte;
+    } while (byte==255);
+    return length;
+}
+
+/**
+ * @brief Decompresses bytes compressed by compressLZ()
+ *
+ * Throws a dmrg::Exception if the data doesn't decode to exactly n bytes.
+ */
+void decompressLZ(const unsigned char* ip, size_t length, 
+	unsigned char* out, size_t n)
+{
+    const unsigned char* end=ip+length;
+    size_t op=0;
+    while (ip<end)
+    {
+	const unsigned token=*ip++;
+	size_t literals=token>>4;
+	if (literals==15)
+	    literals+=readLength(ip, end);
+	if (literals>size_t(end-ip) || literals>n-op)
+	    throw dmrg::Exception("decompressBlock: corrupted data");
+	memcpy(out+op, ip, literals);
+	ip+=literals;
+	op+=literals;
+	if (ip==end)
+	    break;
+
+	if (end-ip<2)
+	    throw dmrg::Exception("decompressBlock: corrupted data");
+	const size_t offset=ip[0] | (size_t(ip[1])<<8);
+	ip+=2;
+	size_t match=token&15;
+	if (match==15)
+	    match+=readLength(ip, end);
+	match+=LZ_MIN_MATCH;
+	if (offset==0 || offset>op || match>n-op)
+	    throw dmrg::Exception("decompressBlock: corrupted data");
+	// byte by byte: the match can overlap what it is copying
+	for (size_t k=0; k<match; k++, op++)
+	    out[op]=out[op-offset];
+    }
+    if (op!=n)
+	throw dmrg::Exception("decompressBlock: corrupted data");
+}
+
+/// compresses one chunk: shuffles the bytes and codes them
+void compressChunk(const double* data, size_t n, 
+	std::vector<unsigned char>& out)
+{
+    const size_t bytes=n*sizeof(double);
+    std::vector<unsigned char> shuffled(bytes);
+    for (size_t e=0; e<n; e++)
+    {
+	unsigned char element[sizeof(double)];
+	memcpy(element, data+e, sizeof(double));
+	for (size_t b=0; b<sizeof(double); b++)
+	    shuffled[b*n+e]=element[b];
+    }
+
+    out.clear();
+    compressLZ(shuffled.data(), bytes, out);
+    if (out.size()>=bytes)
+	out.swap(shuffled);
+}
+
+/// decompresses one chunk compressed by compressChunk()
+void decompressChunk(const unsigned char* in, size_t length, 
+	double* data, size_t n)
+{
+    const size_t bytes=n*sizeof(double);
+    std::vector<unsigned char> shuffled(bytes);
+    if (length==bytes)
+	memcpy(shuffled.data(), in, bytes);
+    else
+	decompressLZ(in, length, shuffled.data(), bytes);
+
+    for (size_t e=0; e<n; e++)
+    {
+	unsigned char element[sizeof(double)];
+	for (size_t b=0; b<sizeof(double); b++)
+	    element[b]=shuffled[b*n+e];
+	memcpy(data+e, element, sizeof(double));
+    }
+}
+
+}
+
+/**
+ * @brief A function to compress the elements of a block
+ *
+ * @param data the elements
+ * @param n the number of elements
+ * @param result on return, the compressed block
+ *
+ * The compression is lossless. The chunks are compressed in parallel if
+ * OpenMP is enabled.
+ */
+void compressBlock(const double* data, size_t n, std::vector<char>& result)
+{
+    const size_t chunks=(n+CODEC_CHUNK-1)/CODEC_CHUNK;
+    std::vector<std::vector<unsigned char> > compressed(chunks);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (long c=0; c<long(chunks); c++)
+    {
+	const size_t first=c*CODEC_CHUNK;
+	const size_t size=(n-first<CODEC_CHUNK)? n-first : CODEC_CHUNK;
+	compressChunk(data+first, size, compressed[c]);
+    }
+
+    std::vector<uint32_t> lengths(chunks+1);
+    lengths[0]=chunks;
+    size_t total=lengths.size()*sizeof(uint32_t);
+    for (size_t c=0; c<chunks; c++)
+    {
+	lengths[c+1]=compressed[c].size();
+	total+=compressed[c].size();
+    }
+
+    result.resize(total);
+    char* p=result.data();
+    memcpy(p, lengths.data(), lengths.size()*sizeof(uint32_t));
+    p+=lengths.size()*sizeof(uint32_t);
+    for (size_t c=0; c<chunks; c++)
+    {
+	memcpy(p, compressed[c].data(), compressed[c].size());
+	p+=compressed[c].size();
+    }
+}
+
+/**
+ * @brief A function to decompress a block compressed by compressBlock()
+ *
+ * @param compressed the compressed block
+ * @param length the length of the compressed block in bytes
+ * @param data where to write the elements
+ * @param n the number of elements
+ *
+ * Throws a dmrg::Exception if the compressed block is not valid. The
+ * chunks are decompressed in parallel if OpenMP is enabled.
+ */
+void decompressBlock(const char* compressed, size_t length, 
+	double* data, size_t n)
+{
+    const size_t chunks=(n+CODEC_CHUNK-1)/CODEC_CHUNK;
+    uint32_t storedChunks=0;
+    if (length>=sizeof(uint32_t))
+	memcpy(&storedChunks, compressed, sizeof(uint32_t));
+    const size_t tableLength=(chunks+1)*sizeof(uint32_t);
+    if (storedChunks!=chunks || length<tableLength)
+	throw dmrg::Exception("decompressBlock: corrupted data");
+
+    std::vector<uint32_t> lengths(chunks+1);
+    memcpy(lengths.data(), compressed, tableLength);
+    std::vector<size_t> offsets(chunks+1, tableLength);
+    for (size_t c=0; c<chunks; c++)
+	offsets[c+1]=offsets[c]+lengths[c+1];
+    if (offsets[chunks]!=length)
+	throw dmrg::Exception("decompressBlock: corrupted data");
+
+    bool corrupted=false;
+    #pragma omp parallel for schedule(dynamic) reduction(||:corrupted)
+    for (long c=0; c<long(chunks); c++)
+    {
+	const size_t first=c*CODEC_CHUNK;
+	const size_t size=(n-first<CODEC_CHUNK)? n-first : CODEC_CHUNK;
+	try
+	{
+	    decompressChunk(reinterpret_cast<const unsigned char*>(
+			compressed+offsets[c]), lengths[c+1], data+first, size);
+	}
+	catch (dmrg::Exception&)
+	{
+	    corrupted=true;
+	}
+    }
+    if (corrupted)
+	throw dmrg::Exception("decompressBlock: corrupted data");
+}
+// end blockCodec.cpp
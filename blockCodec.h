@@ -0,0 +1,47 @@
+/**
+ * @file blockCodec.h
+ *
+ * @brief Interface for the routines that compress the block matrices
+ *
+ * @author Roger Melko 
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$ 
+ */
+#ifndef BLOCK_CODEC_H
+#define BLOCK_CODEC_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+/// code for blocks stored as they are
+const uint32_t BLOCK_CODEC_NONE=0;
+/// code for blocks compressed with compressBlock()
+const uint32_t BLOCK_CODEC_SHUFFLE_LZ=1;
+
+/// number of elements compressed together
+const size_t CODEC_CHUNK=8192;
+
+/**
+ * @brief How the blocks are compressed when they are stored
+ */
+struct BlockCompression
+{
+    /// true to compress the blocks
+    bool enabled;
+    /// elements smaller than this (in absolute value) are stored as
+    /// zeros. Zero means lossless compression
+    double threshold;
+
+    BlockCompression(bool enabled=false, double threshold=0.0)
+	: enabled(enabled), threshold(threshold) {}
+};
+
+void compressBlock(const double* data, size_t n, std::vector<char>& result);
+
+void decompressBlock(const char* compressed, size_t length, 
+	double* data, size_t n);
+
+#endif // BLOCK_CODEC_H
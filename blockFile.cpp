@@ -0,0 +1,341 @@
+/**
+ * @file blockFile.cpp
+ *
+ * @brief Implementation of the routines that store the block matrices on
+ * disk
+ *
+ * @author Roger Melko 
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$ 
+ */
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "blitz/array.h"
+#include "exceptions.h"
+#include "blockCodec.h"
+#include "blockFile.h"
+
+/**
+ * @brief A function to calculate the checksum of the block data
+ *
+ * @param data a pointer to the elements
+ * @param n the number of elements
+ *
+ * @return a Fletcher-like checksum of the 64-bit words of the data
+ *
+ * It runs through the data once with two additions per element, so it
+ * costs about as much as reading the memory.
+ */
+uint64_t blockChecksum(const double* data, size_t n)
+{
+    uint64_t sum1=0;
+    uint64_t sum2=0;
+    for (size_t i=0; i<n; i++)
+    {
+	uint64_t word;
+	memcpy(&word, data+i, sizeof(word));
+	sum1+=word;
+	sum2+=sum1;
+    }
+    return sum1^(sum2<<1);
+}
+
+/**
+ * @brief A function to fill the header for a block
+ *
+ * @param matrix the block Hamiltonian, stored contiguously in row-major
+ * order
+ *
+ * @return a header with the shape and checksum of matrix, for the
+ * elements stored as they are. The sites, sweep and side are left to
+ * zero.
+ */
+BlockFileHeader makeBlockFileHeader(const blitz::Array<double,2>& matrix)
+{
+    BlockFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "DMRGBLK", 8);
+    header.version=BLOCK_FILE_VERSION;
+    header.dtype=BLOCK_FILE_DOUBLE;
+    header.rows=matrix.rows();
+    header.cols=matrix.cols();
+    header.checksum=blockChecksum(matrix.data(), matrix.numElements());
+    header.codec=BLOCK_CODEC_NONE;
+    header.storedBytes=matrix.numElements()*sizeof(double);
+    return header;
+}
+
+/**
+ * @brief A function to check a block header
+ *
+ * @param header the header to check
+ * @param length the number of bytes available for the header and the data
+ * @param what the name of the block, for the error messages
+ *
+ * Throws a dmrg::Exception if the header is not valid or the stored data
+ * doesn't fit in length bytes. It doesn't check the checksum.
+ */
+void checkBlockFileHeader(const BlockFileHeader& header, size_t length,
+	const std::string& what)
+{
+    if (memcmp(header.magic, "DMRGBLK", 8)!=0)
+	throw dmrg::Exception("not a block: "+what);
+    if (header.version!=BLOCK_FILE_VERSION || header.dtype!=BLOCK_FILE_DOUBLE
+	    || (header.codec!=BLOCK_CODEC_NONE && 
+		header.codec!=BLOCK_CODEC_SHUFFLE_LZ))
+	throw dmrg::Exception("wrong block format: "+what);
+    if (header.rows<0 || header.cols<0 || (header.codec==BLOCK_CODEC_NONE &&
+		header.storedBytes!=size_t(header.rows*header.cols)*sizeof(double)))
+	throw dmrg::Exception("wrong block shape: "+what);
+    if (length<sizeof(BlockFileHeader)+header.storedBytes)
+	throw dmrg::Exception("truncated block: "+what);
+}
+
+/**
+ * @brief A function to get a matrix stored contiguously in row-major
+ * order
+ *
+ * @return matrix itself if it is already stored that way, a copy if not
+ */
+blitz::Array<double,2> contiguousBlockMatrix(
+	const blitz::Array<double,2>& matrix)
+{
+    blitz::Array<double,2> result=matrix;
+    if (result.stride(blitz::secondDim)!=1 || 
+	    result.stride(blitz::firstDim)!=result.cols())
+    {
+	result.reference(blitz::Array<double,2>(matrix.rows(), matrix.cols()));
+	result=matrix;
+    }
+    return result;
+}
+
+/**
+ * @brief A function to write a matrix to a binary block file
+ *
+ * @param fname the name of the file
+ * @param matrix the matrix to write
+ *
+ * Writes a BlockFileHeader and then the raw elements of the matrix, so
+ * there is no loss of precision and no formatting. If the matrix is not
+ * stored contiguously in row-major order, a copy is made first.
+ *
+ * The file is written under a temporary name and then renamed, so an
+ * old version of the file that is still mapped (see MappedBlockFile) is
+ * never modified, and a crash never leaves a half written block.
+ */
+void writeBlockMatrix(const char* fname, const blitz::Array<double,2>& matrix)
+{
+    blitz::Array<double,2> data=contiguousBlockMatrix(matrix);
+    const size_t n=data.numElements();
+    BlockFileHeader header=makeBlockFileHeader(data);
+
+    const std::string tmpname=std::string(fname)+".tmp";
+    FILE* fout=fopen(tmpname.c_str(), "wb");
+    if (!fout)
+	throw dmrg::Exception("writeBlockMatrix: can't open "+tmpname);
+    bool ok=fwrite(&header, sizeof(header), 1, fout)==1;
+    ok=ok && fwrite(data.data(), sizeof(double), n, fout)==n;
+    ok=(fclose(fout)==0) && ok;
+    ok=ok && rename(tmpname.c_str(), fname)==0;
+    if (!ok)
+	throw dmrg::Exception(std::string("writeBlockMatrix: can't write ")+fname);
+}
+
+/**
+ * @brief A function to read a matrix from a binary block file
+ *
+ * @param fname the name of the file
+ * @param matrix the matrix to read into. It is resized if needed.
+ *
+ * Checks the header and the checksum, and throws a dmrg::Exception if the
+ * file is not a valid block file.
+ */
+void readBlockMatrix(const char* fname, blitz::Array<double,2>& matrix)
+{
+    FILE* fin=fopen(fname, "rb");
+    if (!fin)
+	throw dmrg::Exception(std::string("readBlockMatrix: can't open ")+fname);
+
+    BlockFileHeader header;
+    if (fread(&header, sizeof(header), 1, fin)!=1)
+    {
+	fclose(fin);
+	throw dmrg::Exception(std::string("readBlockMatrix: truncated file ")
+		+fname);
+    }
+    try
+    {
+	checkBlockFileHeader(header, ~size_t(0), fname);
+    }
+    catch (dmrg::Exception&)
+    {
+	fclose(fin);
+	throw;
+    }
+    if (header.codec!=BLOCK_CODEC_NONE)
+    {
+	fclose(fin);
+	throw dmrg::Exception(std::string("readBlockMatrix: compressed file ")
+		+fname);
+    }
+
+    matrix.resize(header.rows, header.cols);
+    if (matrix.stride(blitz::secondDim)!=1 || 
+	    matrix.stride(blitz::firstDim)!=matrix.cols())
+	matrix.reference(blitz::Array<double,2>(header.rows, header.cols));
+
+    const size_t n=matrix.numElements();
+    bool ok=fread(matrix.data(), sizeof(double), n, fin)==n;
+    fclose(fin);
+    if (!ok || blockChecksum(matrix.data(), n)!=header.checksum)
+	throw dmrg::Exception(std::string("readBlockMatrix: corrupted file ")
+		+fname);
+}
+
+/**
+ * @brief Constructor: maps a block file in memory
+ *
+ * @param fname the name of the block file
+ *
+ * Checks the header, and throws a dmrg::Exception if the file can't be
+ * mapped or is not a valid block file. The data is not copied: the pages
+ * are read from the page cache when they are first used.
+ */
+MappedBlockFile::MappedBlockFile(const char* fname)
+    : address(MAP_FAILED), mappedOffset(0), mappedLength(0)
+{
+    int fd=open(fname, O_RDONLY);
+    if (fd<0)
+	throw dmrg::Exception(std::string("MappedBlockFile: can't open ")+fname);
+    struct stat st;
+    if (fstat(fd, &st)!=0 || st.st_size<(off_t)sizeof(BlockFileHeader))
+    {
+	close(fd);
+	throw dmrg::Exception(std::string("MappedBlockFile: can't map ")+fname);
+    }
+    try
+    {
+	map(fd, 0, st.st_size, fname);
+    }
+    catch (dmrg::Exception&)
+    {
+	close(fd);
+	throw;
+    }
+    close(fd);
+}
+
+/**
+ * @brief Constructor: maps a block stored in a part of a file
+ *
+ * @param fd a file descriptor open for reading
+ * @param offset where the block (its header) starts. Must be a multiple
+ * of the page size
+ * @param length number of bytes to map
+ * @param what the name of the block, for the error messages
+ */
+MappedBlockFile::MappedBlockFile(int fd, off_t offset, size_t length,
+	const std::string& what)
+    : address(MAP_FAILED), mappedOffset(0), mappedLength(0)
+{
+    map(fd, offset, length, what);
+}
+
+/**
+ * @brief Maps the block and checks its header
+ *
+ * The checksum of the data is only checked if the code is built with
+ * DMRG_CHECK_BLOCKS (<tt>make debug=1</tt>): that reads the whole block,
+ * which is what mapping it avoids. Call verify() for that.
+ */
+void MappedBlockFile::map(int fd, off_t offset, size_t length,
+	const std::string& what)
+{
+    if (length<sizeof(BlockFileHeader))
+	throw dmrg::Exception("MappedBlockFile: can't map "+what);
+    address=mmap(0, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, offset);
+    if (address==MAP_FAILED)
+	throw dmrg::Exception("MappedBlockFile: can't map "+what);
+    mappedOffset=offset;
+    mappedLength=length;
+
+    try
+    {
+	checkBlockFileHeader(header(), length, what);
+	if (header().codec!=BLOCK_CODEC_NONE)
+	    throw dmrg::Exception("MappedBlockFile: can't map compressed "
+		    "block "+what);
+#ifdef DMRG_CHECK_BLOCKS
+	verify(what);
+#endif
+    }
+    catch (dmrg::Exception&)
+    {
+	munmap(address, length);
+	throw;
+    }
+}
+
+/**
+ * @brief Checks the checksum of the mapped data
+ *
+ * @param what the name of the block, for the error message
+ *
+ * Throws a dmrg::Exception if the data is corrupted. All the pages of
+ * the block are read.
+ */
+void MappedBlockFile::verify(const std::string& what) const
+{
+    const BlockFileHeader* h=&header();
+    if (blockChecksum(reinterpret_cast<const double*>(h+1), 
+		h->rows*h->cols)!=h->checksum)
+	throw dmrg::Exception("MappedBlockFile: corrupted block "+what);
+}
+
+/**
+ * @brief Destructor: removes the mapping
+ */
+MappedBlockFile::~MappedBlockFile()
+{
+    munmap(address, mappedLength);
+}
+
+/**
+ * @brief A function to get the matrix stored in the mapped block
+ *
+ * @return an array using the mapped memory directly (nothing is copied)
+ */
+blitz::Array<double,2> MappedBlockFile::matrix() const
+{
+    BlockFileHeader* h=static_cast<BlockFileHeader*>(address);
+    return blitz::Array<double,2>(reinterpret_cast<double*>(h+1),
+	    blitz::shape(h->rows, h->cols), blitz::neverDeleteData);
+}
+
+/**
+ * @brief A function to write a matrix as text
+ *
+ * @param fname the name of the file
+ * @param matrix the matrix to write
+ *
+ * Uses the Blitz++ text format (what the code used to store the blocks),
+ * handy to look at a block or to read it with other programs.
+ */
+void exportBlockMatrixText(const char* fname, 
+	const blitz::Array<double,2>& matrix)
+{
+    std::ofstream fout;  
+    fout.open(fname,std::ios::out);
+    fout <<std::setprecision(16)<<matrix ;
+    fout.close();
+}
+// end blockFile.cpp
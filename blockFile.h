@@ -0,0 +1,126 @@
+/**
+ * @file blockFile.h
+ *
+ * @brief Interface for the routines that store the block matrices on disk
+ *
+ * @author Roger Melko 
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$ 
+ */
+#ifndef BLOCK_FILE_H
+#define BLOCK_FILE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <memory>
+#include <string>
+#include "blitz/array.h"
+
+/// current version of the binary block format
+const uint32_t BLOCK_FILE_VERSION=2;
+/// code for the type of the elements: only doubles for now
+const uint32_t BLOCK_FILE_DOUBLE=1;
+
+/**
+ * @brief Header of a binary block
+ *
+ * The header is followed by the elements of the matrix in row-major
+ * order, or by the compressed elements if codec is not BLOCK_CODEC_NONE
+ * (see compressBlock().) It is 64 bytes long, so the data starts aligned to a cache line
+ * (and to whatever alignment the buffer holding the block has.)
+ */
+struct BlockFileHeader
+{
+    /// always "DMRGBLK" 
+    char magic[8];
+    /// version of the format
+    uint32_t version;
+    /// type of the elements
+    uint32_t dtype;
+    /// number of rows of the matrix
+    int64_t rows;
+    /// number of columns of the matrix
+    int64_t cols;
+    /// checksum of the data, see blockChecksum()
+    uint64_t checksum;
+    /// number of sites of the block (0 if unknown)
+    int32_t sites;
+    /// half sweep in which the block was written (-1 for the infinite
+    /// system algorithm)
+    int32_t sweep;
+    /// 'l' or 'r' for left and right blocks (0 if unknown)
+    int32_t side;
+    /// how the data is stored, see blockCodec.h
+    uint32_t codec;
+    /// number of bytes of data after the header
+    uint64_t storedBytes;
+};
+
+uint64_t blockChecksum(const double* data, size_t n);
+
+BlockFileHeader makeBlockFileHeader(const blitz::Array<double,2>& matrix);
+
+void checkBlockFileHeader(const BlockFileHeader& header, size_t length,
+	const std::string& what);
+
+blitz::Array<double,2> contiguousBlockMatrix(
+	const blitz::Array<double,2>& matrix);
+
+void writeBlockMatrix(const char* fname, 
+	const blitz::Array<double,2>& matrix);
+
+void readBlockMatrix(const char* fname, blitz::Array<double,2>& matrix);
+
+/**
+ * @brief A block mapped in memory
+ *
+ * The block (a whole block file, or a record of a block archive) is
+ * mapped privately: the matrix returned by matrix() can be modified, but
+ * the changes never reach the file (pages are copied on write.) The
+ * mapping is removed when the object is destroyed, so keep it alive as
+ * long as you use the matrix.
+ *
+ * Only the header is checked when the block is mapped, so that the data
+ * is read when it is used; verify() checks the data too.
+ */
+class MappedBlockFile {
+    public:
+	explicit MappedBlockFile(const char* fname);
+	MappedBlockFile(int fd, off_t offset, size_t length, 
+		const std::string& what);
+	~MappedBlockFile();
+
+	blitz::Array<double,2> matrix() const;
+	void verify(const std::string& what) const;
+	/// the header of the mapped block
+	const BlockFileHeader& header() const 
+	{ return *static_cast<const BlockFileHeader*>(address); }
+	/// offset of the mapping in the file
+	off_t offset() const { return mappedOffset; }
+	/// length of the mapping in bytes
+	size_t length() const { return mappedLength; }
+
+    private:
+	/// start of the mapping (the header)
+	void* address;
+	/// offset of the mapping in the file
+	off_t mappedOffset;
+	/// length of the mapping in bytes
+	size_t mappedLength;
+
+	void map(int fd, off_t offset, size_t length, const std::string& what);
+
+	// not copyable
+	MappedBlockFile(const MappedBlockFile&);
+	void operator=(const MappedBlockFile&);
+};
+
+/// a mapped block shared by the arrays that use it
+typedef std::shared_ptr<MappedBlockFile> BlockMapping;
+
+void exportBlockMatrixText(const char* fname, 
+	const blitz::Array<double,2>& matrix);
+
+#endif // BLOCK_FILE_H
@@ -0,0 +1,711 @@
+/**
+ * @file blockStore.cpp
+ *
+ * @brief Implementation of the store for the blocks
+ *
+ * @author Roger Melko 
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$ 
+ */
+#include <cstdio>
+#include <string>
+#include "blitz/array.h"
+#include "exceptions.h"
+#include "blockArchive.h"
+#include "blockFile.h"
+#include "memoryUsage.h"
+#include "blockStore.h"
+
+/**
+ * @brief Constructor
+ *
+ * @param memoryBudget the maximum number of bytes of blocks kept in memory
+ * @param scratchDirectory the directory of the archive where blocks are
+ * spilled
+ * @param mapBlocks if true, blocks on disk are mapped in memory instead
+ * of read when they are requested with a BlockMapping
+ * @param maxPendingWrites maximum number of spilled blocks waiting to be
+ * written by the background thread. If 0, blocks are written right away
+ * @param compression how the spilled blocks are compressed, if at all
+ */
+BlockStore::BlockStore(size_t memoryBudget, 
+	const std::string& scratchDirectory, bool mapBlocks, 
+	size_t maxPendingWrites, const BlockCompression& compression)
+    : memoryBudget(memoryBudget), memoryUsed(0), 
+    scratchDirectory(scratchDirectory), mapBlocks(mapBlocks),
+    maxPendingWrites(maxPendingWrites), compression(compression),
+    numberOfHits(0), numberOfMisses(0), numberOfSpills(0), 
+    numberOfPrefetchHits(0), stopIO(false)
+{}
+
+/**
+ * @brief Destructor: stops the background thread and removes the archive
+ * of the spilled blocks
+ */
+BlockStore::~BlockStore()
+{
+    try
+    {
+	flush();
+    }
+    catch (std::exception& e)
+    {
+	std::cerr<<e.what()<<'\n';
+    }
+
+    if (ioThread.joinable())
+    {
+	{
+	    std::lock_guard<std::mutex> lock(ioMutex);
+	    stopIO=true;
+	}
+	ioCondition.notify_all();
+	ioThread.join();
+    }
+
+    if (archive)
+    {
+	const std::string fileName=archive->fileName();
+	archive.reset();
+	remove(fileName.c_str());
+    }
+}
+
+/**
+ * @brief A function to save a block in the store
+ *
+ * @param key the block. A block with the same number of sites and side
+ * is replaced
+ * @param matrix the block Hamiltonian. It is copied, so you can modify it
+ * afterwards
+ */
+void BlockStore::put(const BlockKey& key, 
+	const blitz::Array<double,2>& matrix)
+{
+    blitz::MemoryTagScope memoryTag(BLOCK_CACHE_MEMORY);
+    const Name name(key.sites, key.side);
+    Entry& entry=entries[name];
+    discardPrefetched(name);
+    waitForWrite(name);
+
+    if (entry.inMemory)
+	memoryUsed-=entry.matrix.numElements()*sizeof(double);
+    else
+	entry.recent=recentlyUsed.end();
+
+    // reuse the memory of the old block if it has the same size
+    if (!entry.inMemory || entry.matrix.rows()!=matrix.rows() || 
+	    entry.matrix.cols()!=matrix.cols())
+	entry.matrix.reference(blitz::Array<double,2>(matrix.rows(), 
+		    matrix.cols()));
+    entry.matrix=matrix;
+    entry.sweep=key.sweep;
+    entry.inMemory=true;
+
+    // the copy on disk, if any, is now out of date
+    if (entry.onDisk)
+	archive->release(entry.record);
+    entry.onDisk=false;
+    memoryUsed+=entry.matrix.numElements()*sizeof(double);
+
+    touch(name, entry);
+    spillLeastRecentlyUsed();
+}
+
+/**
+ * @brief A function to get a block from the store
+ *
+ * @param sites the number of sites of the block
+ * @param side 'l' or 'r'
+ * @param matrix on return, a copy of the block Hamiltonian. It is resized
+ * if needed
+ *
+ * Throws a dmrg::Exception if there is no such block.
+ */
+void BlockStore::get(int sites, char side, blitz::Array<double,2>& matrix)
+{
+    const Name name(sites, side);
+    std::map<Name, Entry>::iterator it=entries.find(name);
+    if (it==entries.end())
+	throw dmrg::Exception("BlockStore::get: no block "+
+		std::to_string(sites)+side);
+    Entry& entry=it->second;
+
+    if (entry.inMemory || takeQueuedCopy(name, entry))
+	numberOfHits++;
+    else
+    {
+	numberOfMisses++;
+	loadIntoMemory(name, entry);
+    }
+
+    matrix.resize(entry.matrix.rows(), entry.matrix.cols());
+    matrix=entry.matrix;
+
+    touch(name, entry);
+    spillLeastRecentlyUsed();
+}
+
+/**
+ * @brief A function to get a block from the store without copying it
+ * when it's on disk
+ *
+ * @param sites the number of sites of the block
+ * @param side 'l' or 'r'
+ * @param matrix on return, the block Hamiltonian
+ * @param mapping on entrance, the mapping matrix was using, if any. On
+ * return, the mapping that matrix is using, if any. 
+ *
+ * If the block is in memory, this is the same as get(sites, side,
+ * matrix). If it is on disk, its record in the archive is mapped and
+ * matrix uses the mapped memory directly; keep the mapping while you use
+ * the matrix. You can modify the matrix, but the block in the store
+ * doesn't change. Compressed blocks can't be mapped: they are read as
+ * with get(sites, side, matrix).
+ */
+void BlockStore::get(int sites, char side, blitz::Array<double,2>& matrix,
+	BlockMapping& mapping)
+{
+    // matrix must not use the old mapping after we release it
+    if (mapping)
+	matrix.reference(blitz::Array<double,2>());
+
+    const Name name(sites, side);
+    std::map<Name, Entry>::iterator it=entries.find(name);
+    if (mapBlocks && it!=entries.end() && !it->second.inMemory &&
+	    !takeQueuedCopy(name, it->second) &&
+	    it->second.record.codec==BLOCK_CODEC_NONE)
+    {
+	numberOfMisses++;
+	Prefetch prefetched;
+	if (takePrefetched(name, prefetched) && prefetched.mapping)
+	    mapping=prefetched.mapping;
+	else
+	    mapping=archive->mapRecord(it->second.record);
+	matrix.reference(mapping->matrix());
+	return;
+    }
+
+    mapping.reset();
+    get(sites, side, matrix);
+}
+
+/**
+ * @brief A function to save the truncation matrix of a block
+ *
+ * @param key the block: its number of sites, side and half sweep
+ * @param matrix the truncation matrix that takes the basis of the block
+ * (the basis of the block with one site less, times the added site) to
+ * the states kept, as returned by truncateReducedDM()
+ *
+ * Truncation matrices are stored as any other block, with side 'L' or
+ * 'R' instead of 'l' or 'r', so they are spilled, checkpointed and
+ * restored together with the block Hamiltonians. A matrix for the same
+ * number of sites and side is replaced.
+ */
+void BlockStore::putTransformation(const BlockKey& key, 
+	const blitz::Array<double,2>& matrix)
+{
+    put(BlockKey(key.sites, transformationSide(key.side), key.sweep), 
+	    matrix);
+}
+
+/**
+ * @brief A function to get the truncation matrix of a block
+ *
+ * @param sites the number of sites of the block
+ * @param side 'l' or 'r'
+ * @param matrix on return, a copy of the truncation matrix saved with
+ * putTransformation(). It is resized if needed
+ *
+ * Throws a dmrg::Exception if there is no such matrix.
+ */
+void BlockStore::getTransformation(int sites, char side, 
+	blitz::Array<double,2>& matrix)
+{
+    get(sites, transformationSide(side), matrix);
+}
+
+/**
+ * @brief A function to start loading a block in the background
+ *
+ * @param sites the number of sites of the block
+ * @param side 'l' or 'r'
+ *
+ * Does nothing if the block is in memory (or is not in the store.) If
+ * it is on disk, a background thread maps it (or reads it, if blocks are
+ * not mapped) and the next get() of the block uses the result.
+ */
+void BlockStore::prefetch(int sites, char side)
+{
+    const Name name(sites, side);
+    std::map<Name, Entry>::iterator it=entries.find(name);
+    if (it==entries.end() || it->second.inMemory)
+	return;
+
+    {
+	std::lock_guard<std::mutex> lock(ioMutex);
+	if (prefetches.count(name) || pendingWrites.count(name))
+	    return;
+	prefetches[name];
+    }
+    runInBackground(std::bind(&BlockStore::loadInBackground, this, name,
+		it->second.record));
+}
+
+/**
+ * @brief A function to wait until all the queued blocks are on disk
+ *
+ * Rethrows the errors found writing them.
+ */
+void BlockStore::flush()
+{
+    reapWrites(0);
+}
+
+/**
+ * @brief A function to save all the blocks on disk
+ *
+ * @return the index of the archive, to give to restore()
+ *
+ * The blocks in memory are written to the archive too (and kept in
+ * memory.) The archive keeps the blocks in the index on disk until the
+ * next checkpoint, so save the index right away.
+ */
+std::vector<BlockArchive::Record> BlockStore::checkpoint()
+{
+    openArchive();
+    flush();
+    std::map<Name, Entry>::iterator it;
+    for (it=entries.begin(); it!=entries.end(); ++it)
+    {
+	Entry& entry=it->second;
+	if (entry.onDisk)
+	    continue;
+	entry.record=archive->write(
+		BlockKey(it->first.first, it->first.second, entry.sweep),
+		entry.matrix, compression);
+	entry.onDisk=true;
+    }
+    return archive->snapshot();
+}
+
+/**
+ * @brief A function to pick up the blocks saved by checkpoint()
+ *
+ * @param index the index returned by checkpoint()
+ *
+ * The archive of the checkpoint must be in the scratch directory of this
+ * store, which must be empty. The blocks are read when they are needed.
+ */
+void BlockStore::restore(const std::vector<BlockArchive::Record>& index)
+{
+    if (!entries.empty())
+	throw dmrg::Exception("BlockStore::restore: the store is not empty");
+    archive.reset(new BlockArchive(archiveFileName(), index));
+    for (size_t i=0; i<index.size(); i++)
+    {
+	const BlockKey& key=index[i].key;
+	Entry& entry=entries[Name(key.sites, key.side)];
+	entry.sweep=key.sweep;
+	entry.onDisk=true;
+	entry.record=index[i];
+	entry.recent=recentlyUsed.end();
+    }
+}
+
+/**
+ * @brief A function to print how the store has been doing
+ */
+void BlockStore::printStatistics(std::ostream& os) const
+{
+    os<<"block store: "<<numberOfHits<<" hits, "<<numberOfMisses
+	<<" misses ("<<numberOfPrefetchHits<<" prefetched), "
+	<<numberOfSpills<<" spills, "
+	<<memoryUsed/(1024.0*1024.0)<<" MB in memory";
+    if (archive)
+	os<<", "<<archive->size()/(1024.0*1024.0)<<" MB in "
+	    <<archive->fileName();
+    os<<'\n';
+
+    if (archive && compression.enabled)
+    {
+	const BlockArchive::CompressionStatistics s=
+	    archive->compressionStatistics();
+	const double MB=1024.0*1024.0;
+	os<<"block compression: ratio "
+	    <<(s.storedBytes>0? s.rawBytes/s.storedBytes : 0.0)
+	    <<", compress "<<(s.compressSeconds>0? 
+		    s.rawBytes/MB/s.compressSeconds : 0.0)<<" MB/s"
+	    <<", decompress "<<(s.decompressSeconds>0?
+		    s.decompressedBytes/MB/s.decompressSeconds : 0.0)<<" MB/s\n";
+    }
+}
+
+/**
+ * @brief A function to get the archive for the spilled blocks, creating
+ * it if needed
+ */
+BlockArchive& BlockStore::openArchive()
+{
+    if (!archive)
+	archive.reset(new BlockArchive(archiveFileName()));
+    return *archive;
+}
+
+/**
+ * @brief Gives the side under which the truncation matrices of the
+ * blocks of a side are stored
+ */
+char BlockStore::transformationSide(char side)
+{
+    if (side!='l' && side!='r')
+	throw dmrg::Exception(std::string("BlockStore: wrong side ")+side);
+    return side=='l'? 'L' : 'R';
+}
+
+/**
+ * @brief A function to get the name of the archive for the spilled blocks
+ */
+std::string BlockStore::archiveFileName() const
+{
+    return scratchDirectory+"/blocks.dmrg";
+}
+
+/**
+ * @brief Moves a block to the front of the recently used list
+ */
+void BlockStore::touch(const Name& name, Entry& entry)
+{
+    if (entry.recent!=recentlyUsed.end())
+	recentlyUsed.erase(entry.recent);
+    recentlyUsed.push_front(name);
+    entry.recent=recentlyUsed.begin();
+}
+
+/**
+ * @brief Writes to disk the least recently used blocks until the blocks
+ * in memory fit in the budget
+ *
+ * The most recently used block always stays in memory.
+ */
+void BlockStore::spillLeastRecentlyUsed()
+{
+    while (memoryUsed>memoryBudget && recentlyUsed.size()>1)
+    {
+	const Name name=recentlyUsed.back();
+	Entry& entry=entries[name];
+
+	if (!entry.onDisk)
+	{
+	    openArchive();
+	    if (maxPendingWrites>0)
+		queueWrite(name, entry);
+	    else
+		entry.record=archive->write(
+			BlockKey(name.first, name.second, entry.sweep),
+			entry.matrix, compression);
+	    entry.onDisk=true;
+	    numberOfSpills++;
+	}
+	memoryUsed-=entry.matrix.numElements()*sizeof(double);
+	entry.matrix.free();
+	entry.inMemory=false;
+	recentlyUsed.pop_back();
+	entry.recent=recentlyUsed.end();
+    }
+}
+
+/**
+ * @brief Brings a block that is on disk to memory
+ *
+ * Uses the prefetched block if there is one, otherwise reads the archive.
+ */
+void BlockStore::loadIntoMemory(const Name& name, Entry& entry)
+{
+    blitz::MemoryTagScope memoryTag(BLOCK_CACHE_MEMORY);
+    Prefetch prefetched;
+    if (takePrefetched(name, prefetched) && prefetched.mapping)
+    {
+	entry.matrix.reference(blitz::Array<double,2>(
+		    prefetched.mapping->matrix().shape()));
+	entry.matrix=prefetched.mapping->matrix();
+    }
+    else if (prefetched.ready)
+	entry.matrix.reference(prefetched.matrix);
+    else
+	archive->readRecord(entry.record, entry.matrix);
+
+    entry.inMemory=true;
+    entry.recent=recentlyUsed.end();
+    memoryUsed+=entry.matrix.numElements()*sizeof(double);
+}
+
+/**
+ * @brief Gets a prefetched block, waiting for the background thread if
+ * it is not loaded yet
+ *
+ * @param name the block
+ * @param result on return, the prefetched block
+ *
+ * @return false if the block was not prefetched
+ *
+ * Rethrows in the main thread the errors found loading the block.
+ */
+bool BlockStore::takePrefetched(const Name& name, Prefetch& result)
+{
+    std::unique_lock<std::mutex> lock(ioMutex);
+    std::map<Name, Prefetch>::iterator it=prefetches.find(name);
+    if (it==prefetches.end())
+	return false;
+    while (!it->second.ready)
+	ioCondition.wait(lock);
+
+    std::string error=it->second.error;
+    result.matrix.reference(it->second.matrix);
+    result.mapping=it->second.mapping;
+    result.ready=true;
+    prefetches.erase(it);
+    lock.unlock();
+
+    if (!error.empty())
+	throw dmrg::Exception(error);
+    numberOfPrefetchHits++;
+    return true;
+}
+
+/**
+ * @brief Drops the prefetched copy of a block that is about to change
+ */
+void BlockStore::discardPrefetched(const Name& name)
+{
+    std::unique_lock<std::mutex> lock(ioMutex);
+    std::map<Name, Prefetch>::iterator it=prefetches.find(name);
+    if (it==prefetches.end())
+	return;
+    while (!it->second.ready)
+	ioCondition.wait(lock);
+    prefetches.erase(it);
+}
+
+/**
+ * @brief Loads a block from disk: runs in the background thread
+ *
+ * Only the archive and the Prefetch slot of the block are used here. The
+ * slot is filled while holding the lock, as the main thread looks at it;
+ * the reference counts of the arrays are atomic, so the block can be
+ * released here after the main thread has taken it.
+ */
+void BlockStore::loadInBackground(const Name& name, 
+	const BlockArchive::Record& record)
+{
+    BlockMapping mapping;
+    std::string error;
+    blitz::Array<double,2> matrix;
+    try 
+    {
+	if (mapBlocks && record.codec==BLOCK_CODEC_NONE)
+	    mapping=archive->mapRecord(record);
+	else
+	    archive->readRecord(record, matrix);
+    }
+    catch (std::exception& e)
+    {
+	error=e.what();
+    }
+
+    {
+	std::lock_guard<std::mutex> lock(ioMutex);
+	Prefetch& slot=prefetches[name];
+	slot.matrix.reference(matrix);
+	slot.mapping=mapping;
+	slot.error=error;
+	slot.ready=true;
+    }
+    ioCondition.notify_all();
+}
+
+/**
+ * @brief Writes a block to disk: runs in the background thread
+ *
+ * Uses the data of the queued block through a view that doesn't touch
+ * its reference count.
+ */
+void BlockStore::writeInBackground(const Name& name, const BlockKey& key,
+	const double* data, int rows, int cols)
+{
+    BlockArchive::Record record;
+    std::string error;
+    try 
+    {
+	blitz::Array<double,2> view(const_cast<double*>(data), 
+		blitz::shape(rows, cols), blitz::neverDeleteData);
+	record=archive->write(key, view, compression);
+    }
+    catch (std::exception& e)
+    {
+	error=e.what();
+    }
+
+    {
+	std::lock_guard<std::mutex> lock(ioMutex);
+	PendingWrite& slot=pendingWrites[name];
+	slot.record=record;
+	slot.error=error;
+	slot.done=true;
+    }
+    ioCondition.notify_all();
+}
+
+/**
+ * @brief Queues a block to be written by the background thread
+ *
+ * Waits if there are already maxPendingWrites blocks in the queue. The
+ * queue keeps a reference to the memory of the block, so nothing is
+ * copied.
+ */
+void BlockStore::queueWrite(const Name& name, Entry& entry)
+{
+    waitForWrite(name);
+    reapWrites(maxPendingWrites-1);
+    {
+	std::lock_guard<std::mutex> lock(ioMutex);
+	PendingWrite& slot=pendingWrites[name];
+	slot.matrix.reference(entry.matrix);
+	slot.done=false;
+    }
+    runInBackground(std::bind(&BlockStore::writeInBackground, this, name,
+		BlockKey(name.first, name.second, entry.sweep), 
+		entry.matrix.data(), entry.matrix.rows(), entry.matrix.cols()));
+}
+
+/**
+ * @brief Brings back to memory a block that is queued to be written
+ *
+ * @return false if the block is not in the queue
+ */
+bool BlockStore::takeQueuedCopy(const Name& name, Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(ioMutex);
+    std::map<Name, PendingWrite>::iterator it=pendingWrites.find(name);
+    if (it==pendingWrites.end())
+	return false;
+
+    entry.matrix.reference(it->second.matrix);
+    entry.inMemory=true;
+    entry.recent=recentlyUsed.end();
+    memoryUsed+=entry.matrix.numElements()*sizeof(double);
+    return true;
+}
+
+/**
+ * @brief Waits until a queued block is on disk and removes it from the
+ * queue. Does nothing if the block is not in the queue.
+ */
+void BlockStore::waitForWrite(const Name& name)
+{
+    std::unique_lock<std::mutex> lock(ioMutex);
+    std::map<Name, PendingWrite>::iterator it=pendingWrites.find(name);
+    if (it==pendingWrites.end())
+	return;
+    while (!it->second.done)
+	ioCondition.wait(lock);
+
+    finishWrite(name, it->second);
+    std::string error=it->second.error;
+    pendingWrites.erase(it);
+    lock.unlock();
+    if (!error.empty())
+	throw dmrg::Exception(error);
+}
+
+/**
+ * @brief Takes note of where a queued block was written
+ */
+void BlockStore::finishWrite(const Name& name, const PendingWrite& write)
+{
+    if (write.error.empty())
+	entries[name].record=write.record;
+}
+
+/**
+ * @brief Removes from the queue the blocks already written, waiting
+ * until at most maxLeft blocks are left in the queue
+ *
+ * Rethrows the errors found writing the blocks.
+ */
+void BlockStore::reapWrites(size_t maxLeft)
+{
+    std::unique_lock<std::mutex> lock(ioMutex);
+    std::string error;
+    while (true)
+    {
+	std::map<Name, PendingWrite>::iterator it=pendingWrites.begin();
+	while (it!=pendingWrites.end())
+	    if (it->second.done)
+	    {
+		finishWrite(it->first, it->second);
+		if (error.empty()) error=it->second.error;
+		pendingWrites.erase(it++);
+	    }
+	    else
+		++it;
+	if (pendingWrites.size()<=maxLeft)
+	    break;
+	ioCondition.wait(lock);
+    }
+    lock.unlock();
+    if (!error.empty())
+	throw dmrg::Exception(error);
+}
+
+/**
+ * @brief Queues a job for the background thread, starting it if needed
+ */
+void BlockStore::runInBackground(const std::function<void()>& job)
+{
+    {
+	std::lock_guard<std::mutex> lock(ioMutex);
+	ioQueue.push_back(job);
+    }
+    if (!ioThread.joinable())
+	ioThread=std::thread(&BlockStore::ioLoop, this);
+    ioCondition.notify_all();
+}
+
+/**
+ * @brief The loop of the background thread: runs the queued jobs until
+ * the store is destroyed
+ */
+void BlockStore::ioLoop()
+{
+    blitz::MemoryTagScope memoryTag(BLOCK_CACHE_MEMORY);
+    std::unique_lock<std::mutex> lock(ioMutex);
+    while (true)
+    {
+	while (ioQueue.empty() && !stopIO)
+	    ioCondition.wait(lock);
+	if (ioQueue.empty())
+	    return;
+	std::function<void()> job=ioQueue.front();
+	ioQueue.pop_front();
+	lock.unlock();
+	job();
+	lock.lock();
+    }
+}
+
+/**
+ * @brief A function to get the store used by default by the blocks
+ *
+ * It keeps up to 1 GB of blocks in memory and spills to the current
+ * directory.
+ */
+BlockStore& defaultBlockStore()
+{
+    static BlockStore store(size_t(1024)*1024*1024, ".");
+    return store;
+}
+// end blockStore.cpp
@@ -0,0 +1,210 @@
+/**
+ * @file blockStore.h
+ *
+ * @brief A class that keeps the blocks in memory and spills them to disk
+ * when there is not enough memory
+ *
+ * @author Roger Melko 
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$ 
+ */
+#ifndef BLOCK_STORE_H
+#define BLOCK_STORE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "blitz/array.h"
+#include "blockArchive.h"
+#include "blockFile.h"
+
+/**
+ * @brief A store for the block Hamiltonians saved during the DMRG
+ *
+ * Blocks are stored by number of sites and side, and kept in memory
+ * while the total size of the blocks in memory is below a budget. When
+ * the budget is exceeded, the least recently used blocks are written to
+ * a BlockArchive in the scratch directory and read back when they are
+ * needed again. The archive is created with the first spilled block and
+ * removed with the store.
+ * The store counts how many requests were served from memory (hits) and
+ * how many had to go to disk (misses).
+ *
+ * Blocks that are on disk can be handed out as a mapping of their record
+ * in the archive (see MappedBlockFile) instead of being read: then the array uses the
+ * pages of the page cache directly.
+ *
+ * A block that will be needed soon can be prefetched: a background
+ * thread maps (or reads) it while the main thread keeps working, and
+ * the next get() picks it up without waiting for the disk.
+ *
+ * Spilled blocks are written by the same thread (write-behind): the
+ * block is queued and the main thread goes on. A get() of a block still
+ * in the queue uses the queued copy. At most maxPendingWrites blocks
+ * wait in the queue; call flush() to wait for all of them.
+ *
+ * Spilled blocks can be compressed (see BlockCompression). Compressed
+ * blocks are always read, never mapped.
+ *
+ * The store also keeps the truncation matrix of each block (see
+ * putTransformation()), so the state of the chain can be put together
+ * at the end of the run.
+ *
+ * checkpoint() writes all the blocks to the archive and returns its
+ * index; a new store can pick them up from there with restore().
+ */
+class BlockStore {
+    public:
+	BlockStore(size_t memoryBudget, const std::string& scratchDirectory,
+		bool mapBlocks=true, size_t maxPendingWrites=4,
+		const BlockCompression& compression=BlockCompression());
+	~BlockStore();
+
+	void put(const BlockKey& key, const blitz::Array<double,2>& matrix);
+	void get(int sites, char side, blitz::Array<double,2>& matrix);
+	void get(int sites, char side, blitz::Array<double,2>& matrix,
+		BlockMapping& mapping);
+	void putTransformation(const BlockKey& key, 
+		const blitz::Array<double,2>& matrix);
+	void getTransformation(int sites, char side, 
+		blitz::Array<double,2>& matrix);
+	void prefetch(int sites, char side);
+	void flush();
+	std::vector<BlockArchive::Record> checkpoint();
+	void restore(const std::vector<BlockArchive::Record>& index);
+
+	/// number of get() served from memory
+	size_t hits() const { return numberOfHits; }
+	/// number of get() that had to read the block from disk
+	size_t misses() const { return numberOfMisses; }
+	/// number of blocks written to disk to stay within the budget
+	size_t spills() const { return numberOfSpills; }
+	/// number of misses that were already loaded by prefetch()
+	size_t prefetchHits() const { return numberOfPrefetchHits; }
+
+	void printStatistics(std::ostream& os) const;
+
+    private:
+	/// a block in the store: number of sites and side
+	typedef std::pair<int, char> Name;
+
+	/// a stored block
+	struct Entry {
+	    /// the matrix, empty if the block is on disk only
+	    blitz::Array<double,2> matrix;
+	    /// half sweep in which the block was saved
+	    int sweep;
+	    /// true if the block is in memory
+	    bool inMemory;
+	    /// true if there is an up to date copy on disk
+	    bool onDisk;
+	    /// where the copy on disk is
+	    BlockArchive::Record record;
+	    /// position in the list of recently used blocks
+	    std::list<Name>::iterator recent;
+
+	    Entry() : sweep(-1), inMemory(false), onDisk(false) {}
+	};
+
+	/// a block loaded by the background thread
+	struct Prefetch {
+	    /// the block, if it was read
+	    blitz::Array<double,2> matrix;
+	    /// the mapped block file, if it was mapped
+	    BlockMapping mapping;
+	    /// true when the background thread is done with it
+	    bool ready;
+	    /// the error message if loading the block failed
+	    std::string error;
+
+	    Prefetch() : ready(false) {}
+	};
+
+	/// a block queued to be written by the background thread
+	struct PendingWrite {
+	    /// the block. The background thread only uses its data, so only
+	    /// the main thread changes the reference count
+	    blitz::Array<double,2> matrix;
+	    /// where the block was written
+	    BlockArchive::Record record;
+	    /// true when the block is on disk
+	    bool done;
+	    /// the error message if writing the block failed
+	    std::string error;
+
+	    PendingWrite() : done(false) {}
+	};
+
+	std::map<Name, Entry> entries;
+	/// names of the blocks in memory, the most recently used first
+	std::list<Name> recentlyUsed;
+	/// where the blocks are spilled, created when it's first needed
+	std::unique_ptr<BlockArchive> archive;
+
+	size_t memoryBudget;
+	size_t memoryUsed;
+	std::string scratchDirectory;
+	/// true if blocks on disk are mapped instead of read
+	bool mapBlocks;
+	/// maximum number of blocks waiting to be written, 0 to write them
+	/// right away
+	size_t maxPendingWrites;
+	/// how the spilled blocks are compressed
+	BlockCompression compression;
+
+	size_t numberOfHits;
+	size_t numberOfMisses;
+	size_t numberOfSpills;
+	size_t numberOfPrefetchHits;
+
+	/// @name Background input/output
+	/// everything here is guarded by ioMutex
+	//@{
+	std::map<Name, Prefetch> prefetches;
+	std::map<Name, PendingWrite> pendingWrites;
+	std::deque<std::function<void()> > ioQueue;
+	std::mutex ioMutex;
+	std::condition_variable ioCondition;
+	std::thread ioThread;
+	bool stopIO;
+	//@}
+
+	static char transformationSide(char side);
+	std::string archiveFileName() const;
+	BlockArchive& openArchive();
+	void touch(const Name& name, Entry& entry);
+	void spillLeastRecentlyUsed();
+	void loadIntoMemory(const Name& name, Entry& entry);
+	bool takePrefetched(const Name& name, Prefetch& result);
+	void discardPrefetched(const Name& name);
+	void loadInBackground(const Name& name, 
+		const BlockArchive::Record& record);
+	void writeInBackground(const Name& name, const BlockKey& key,
+		const double* data, int rows, int cols);
+	void queueWrite(const Name& name, Entry& entry);
+	bool takeQueuedCopy(const Name& name, Entry& entry);
+	void waitForWrite(const Name& name);
+	void finishWrite(const Name& name, const PendingWrite& write);
+	void reapWrites(size_t maxLeft);
+	void runInBackground(const std::function<void()>& job);
+	void ioLoop();
+
+	// not copyable
+	BlockStore(const BlockStore&);
+	void operator=(const BlockStore&);
+};
+
+BlockStore& defaultBlockStore();
+
+#endif // BLOCK_STORE_H
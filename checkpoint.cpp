@@ -0,0 +1,142 @@
+/**
+ * @file checkpoint.cpp
+ *
+ * @brief Implementation of the routines that save and restore a DMRG run
+ *
+ * A checkpoint file is binary: the magic "DMRGCKP", the version, and then
+ * the fields of the Checkpoint in order. Matrices are stored as their
+ * shape followed by the elements in row-major order, strings and vectors
+ * as their size followed by the elements. It ends with the magic again,
+ * to catch truncated files.
+ *
+ * @author Roger Melko 
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$ 
+ */
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include "blitz/array.h"
+#include "exceptions.h"
+#include "binaryFile.h"
+#include "checkpoint.h"
+
+/**
+ * @brief A function to save a checkpoint
+ *
+ * @param fname the name of the checkpoint file
+ * @param checkpoint what to save
+ *
+ * The file is written under a temporary name, flushed to disk and then
+ * renamed, so the previous checkpoint stays until the new one is
+ * complete.
+ */
+void writeCheckpoint(const std::string& fname, const Checkpoint& checkpoint)
+{
+    const std::string tmpname=fname+".tmp";
+    BinaryFile out(tmpname, "wb");
+    if (!out.ok)
+	throw dmrg::Exception("writeCheckpoint: can't open "+tmpname);
+
+    out.write("DMRGCKP", 8);
+    out.write(CHECKPOINT_VERSION);
+    out.write(int32_t(checkpoint.m));
+    out.write(int32_t(checkpoint.numberOfSites));
+    out.write(int32_t(checkpoint.numberOfHalfSweeps));
+    out.write(int32_t(checkpoint.targets));
+    out.write(checkpoint.noiseDecay);
+    out.write(int32_t(checkpoint.halfSweep));
+    out.write(int32_t(checkpoint.sitesInSystem));
+    out.write(checkpoint.noise);
+    out.write(checkpoint.systemBlock);
+    out.write(checkpoint.S_z);
+    out.write(checkpoint.S_p);
+    out.write(int64_t(checkpoint.Psi.size()));
+    for (size_t n=0; n<checkpoint.Psi.size(); n++)
+	out.write(checkpoint.Psi[n]);
+    out.write(checkpoint.randomState);
+    out.write(int64_t(checkpoint.blocks.size()));
+    for (size_t b=0; b<checkpoint.blocks.size(); b++)
+    {
+	const BlockArchive::Record& record=checkpoint.blocks[b];
+	out.write(int32_t(record.key.sites));
+	out.write(int32_t(record.key.side));
+	out.write(int32_t(record.key.sweep));
+	out.write(uint32_t(record.codec));
+	out.write(int64_t(record.offset));
+	out.write(int64_t(record.rows));
+	out.write(int64_t(record.cols));
+	out.write(int64_t(record.capacity));
+    }
+    out.write("DMRGCKP", 8);
+
+    if (out.ok)
+	out.ok=fflush(out.file)==0 && fsync(fileno(out.file))==0;
+    if (!out.close() || rename(tmpname.c_str(), fname.c_str())!=0)
+	throw dmrg::Exception("writeCheckpoint: can't write "+fname);
+}
+
+/**
+ * @brief A function to read a checkpoint
+ *
+ * @param fname the name of the checkpoint file
+ * @param checkpoint on return, what was saved
+ *
+ * Throws a dmrg::Exception if the file is not a valid checkpoint.
+ */
+void readCheckpoint(const std::string& fname, Checkpoint& checkpoint)
+{
+    BinaryFile in(fname, "rb");
+    if (!in.ok)
+	throw dmrg::Exception("readCheckpoint: can't open "+fname);
+
+    char magic[8];
+    uint32_t version=0;
+    in.read(magic, 8);
+    in.read(version);
+    if (!in.ok || memcmp(magic, "DMRGCKP", 8)!=0 || 
+	    version!=CHECKPOINT_VERSION)
+	throw dmrg::Exception("readCheckpoint: not a checkpoint: "+fname);
+
+    int32_t value[4];
+    in.read(value, sizeof(value));
+    checkpoint.m=value[0];
+    checkpoint.numberOfSites=value[1];
+    checkpoint.numberOfHalfSweeps=value[2];
+    checkpoint.targets=value[3];
+    in.read(checkpoint.noiseDecay);
+    in.read(value, 2*sizeof(int32_t));
+    checkpoint.halfSweep=value[0];
+    checkpoint.sitesInSystem=value[1];
+    in.read(checkpoint.noise);
+    in.read(checkpoint.systemBlock);
+    in.read(checkpoint.S_z);
+    in.read(checkpoint.S_p);
+    checkpoint.Psi.resize(in.readSize(sizeof(double)));
+    for (size_t n=0; n<checkpoint.Psi.size(); n++)
+	in.read(checkpoint.Psi[n]);
+    in.read(checkpoint.randomState);
+    checkpoint.blocks.resize(in.readSize(64));
+    for (size_t b=0; b<checkpoint.blocks.size(); b++)
+    {
+	BlockArchive::Record& record=checkpoint.blocks[b];
+	int32_t key[3];
+	uint32_t codec=0;
+	int64_t place[4];
+	in.read(key, sizeof(key));
+	in.read(codec);
+	in.read(place, sizeof(place));
+	record.key=BlockKey(key[0], char(key[1]), key[2]);
+	record.codec=codec;
+	record.offset=place[0];
+	record.rows=place[1];
+	record.cols=place[2];
+	record.capacity=place[3];
+    }
+    in.read(magic, 8);
+    if (!in.ok || memcmp(magic, "DMRGCKP", 8)!=0)
+	throw dmrg::Exception("readCheckpoint: corrupted file "+fname);
+}
+// end checkpoint.cpp
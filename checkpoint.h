@@ -0,0 +1,83 @@
+/**
+ * @file checkpoint.h
+ *
+ * @brief Interface for the routines that save and restore a DMRG run
+ *
+ * @author Roger Melko 
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$ 
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include "blitz/array.h"
+#include "blockArchive.h"
+
+/// current version of the checkpoint format
+const uint32_t CHECKPOINT_VERSION=1;
+
+/**
+ * @brief Everything needed to resume the finite system algorithm
+ *
+ * A checkpoint is taken at the start of a step of the finite system
+ * algorithm: sitesInSystem sites in the system block, in half sweep
+ * halfSweep. The system block grows to the right in even half sweeps
+ * and to the left in odd ones. The other blocks are in the block archive
+ * of the run, and blocks is its index (see BlockStore::checkpoint()).
+ */
+struct Checkpoint
+{
+    /// @name Parameters of the run
+    //@{
+    /// number of states kept
+    int m;
+    /// number of sites in the chain
+    int numberOfSites;
+    /// number of half sweeps of the finite system algorithm
+    int numberOfHalfSweeps;
+    /// number of target states
+    int targets;
+    /// factor multiplying the noise after each half sweep
+    double noiseDecay;
+    //@}
+
+    /// @name Where the run is
+    //@{
+    /// the half sweep
+    int halfSweep;
+    /// number of sites in the system block
+    int sitesInSystem;
+    /// amplitude of the density matrix perturbation
+    double noise;
+    //@}
+
+    /// @name The state of the run
+    //@{
+    /// the system block Hamiltonian
+    blitz::Array<double,2> systemBlock;
+    /// the S_z operator of the site added to the blocks
+    blitz::Array<double,2> S_z;
+    /// the S_p operator of the site added to the blocks
+    blitz::Array<double,2> S_p;
+    /// the target wavefunctions of the last step
+    std::vector<blitz::Array<double,2> > Psi;
+    /// the state of the random number generator of the Lanczos
+    std::string randomState;
+    /// the index of the block archive
+    std::vector<BlockArchive::Record> blocks;
+    //@}
+
+    Checkpoint() : m(0), numberOfSites(0), numberOfHalfSweeps(0), 
+	targets(0), noiseDecay(0.0), halfSweep(0), sitesInSystem(0), 
+	noise(0.0) {}
+};
+
+void writeCheckpoint(const std::string& fname, const Checkpoint& checkpoint);
+
+void readCheckpoint(const std::string& fname, Checkpoint& checkpoint);
+
+#endif // CHECKPOINT_H
@@ -10,10 +10,12 @@
  *
  * $Revision$ 
  */
+#include <algorithm>
+#include <vector>
 #include "blitz/array.h"
 #include "exceptions.h"
-#include "tred3.h"
-#include "tqli2.h"
+#include "linearAlgebra.h"
+#include "memoryUsage.h"
 #include "densityMatrix.h"
 
 /**
@@ -35,21 +37,157 @@ blitz::Array<double,2> transformOperator(const blitz::Array<double,2>& op,
 	const blitz::Array<double,2>& transposed_transformation_matrix,
 	const blitz::Array<double,2>& transformation_matrix)
 {
-    blitz::firstIndex i;
-    blitz::secondIndex j;
-    blitz::thirdIndex k;
+    blitz::MemoryTagScope memoryTag(BLOCK_OPERATOR_MEMORY);
+    LinearAlgebraBackend& backend=linearAlgebra();
 
     blitz::Array<double,2> tmp(op.rows(),
 	    transposed_transformation_matrix.cols());
-    tmp=sum(op(i,k)*transposed_transformation_matrix(k,j),k);
+    backend.gemm(false, false, 1.0, op, transposed_transformation_matrix,
+	    0.0, tmp);
 
     blitz::Array<double,2> result(transformation_matrix.rows(), 
 	    tmp.cols());
-    result=sum(transformation_matrix(i,k)*tmp(k,j),k);
+    backend.gemm(false, false, 1.0, transformation_matrix, tmp, 0.0, result);
 
     return result;
 }
 
+/// number of columns of the transformed operators done in one pass
+const int TRANSFORM_PANEL=32;
+
+/**
+ * @brief Dot product of two contiguous arrays
+ */
+static inline double dotRows(const double* a, const double* b, int n)
+{
+    double s=0.0;
+#pragma omp simd reduction(+:s)
+    for (int k=0; k<n; k++)
+	s+=a[k]*b[k];
+    return s;
+}
+
+/**
+ * @brief A function to transform a set of operators to the new
+ * (truncated) basis in one pass
+ *
+ * @param operators the operators to transform and where to store them
+ * @param transformation_matrix a matrix transforming the old basis to the
+ * new (truncated) one, as returned by truncateReducedDM
+ *
+ * Does the same as calling transformOperator for each operator, but the
+ * transformation matrix is not transposed and each panel of it is
+ * reused for all the operators while it is in cache. For every operator
+ * and panel of columns of the result we first get 
+ * tmp = (O*op^T)[panel], with the panel stored as rows, and then 
+ * result[:,panel]= O*tmp^T. Both steps are dot products of contiguous rows.
+ * Only the upper triangle of the symmetric operators is calculated and then
+ * copied to the lower one. Panels are independent, so they are shared
+ * among threads.
+ *
+ * If the linear algebra backend is a tuned library (see
+ * LinearAlgebraBackend::tuned()), its two matrix products per operator
+ * are faster than this kernel, and they are used instead.
+ */
+void transformOperators(std::vector<OperatorTransform>& operators, 
+	const blitz::Array<double,2>& transformation_matrix)
+{
+    blitz::MemoryTagScope memoryTag(BLOCK_OPERATOR_MEMORY);
+    const int m=transformation_matrix.rows();
+    const int n=transformation_matrix.cols();
+
+    // everything below works on contiguous row-major matrices
+    blitz::Array<double,2> OO=transformation_matrix;
+    if (OO.stride(blitz::secondDim)!=1 || OO.stride(blitz::firstDim)!=n)
+    {
+	OO.reference(blitz::Array<double,2>(m,n));
+	OO=transformation_matrix;
+    }
+    std::vector<blitz::Array<double,2> > ops(operators.size());
+    for (size_t a=0; a<operators.size(); a++)
+    {
+	const blitz::Array<double,2>& op=*operators[a].op;
+	if (op.rows()!=n || op.cols()!=n)
+	    throw dmrg::Exception("transformOperators: wrong dims");
+	ops[a].reference(op);
+	if (op.stride(blitz::secondDim)!=1 || op.stride(blitz::firstDim)!=n)
+	{
+	    ops[a].reference(blitz::Array<double,2>(n,n));
+	    ops[a]=op;
+	}
+	blitz::Array<double,2>& result=*operators[a].result;
+	result.resize(m,m);
+	if (result.stride(blitz::secondDim)!=1 || 
+		result.stride(blitz::firstDim)!=m)
+	    result.reference(blitz::Array<double,2>(m,m));
+    }
+
+    LinearAlgebraBackend& backend=linearAlgebra();
+    if (backend.tuned())
+    {
+	blitz::Array<double,2> tmp(n,m);
+	for (size_t a=0; a<operators.size(); a++)
+	{
+	    backend.gemm(false, true, 1.0, ops[a], OO, 0.0, tmp);
+	    backend.gemm(false, false, 1.0, OO, tmp, 0.0, 
+		    *operators[a].result);
+	}
+	return;
+    }
+
+    const double* o=OO.data();
+
+#pragma omp parallel
+    {
+	std::vector<double> tmp(TRANSFORM_PANEL*n);
+
+#pragma omp for schedule(dynamic)
+	for (int jb=0; jb<m; jb+=TRANSFORM_PANEL)
+	{
+	    const int jend=std::min(jb+TRANSFORM_PANEL, m);
+	    for (size_t a=0; a<operators.size(); a++)
+	    {
+		const double* p=ops[a].data();
+		double* r=operators[a].result->data();
+
+		// tmp(j,k) = sum_l O(j,l) op(k,l)
+		for (int j=jb; j<jend; j++)
+		    for (int k=0; k<n; k++)
+			tmp[(j-jb)*n+k]=dotRows(o+j*n, p+k*n, n);
+
+		// result(i,j) = sum_k O(i,k) tmp(j,k)
+		const int iend=operators[a].symmetric? jend : m;
+		for (int i=0; i<iend; i++)
+		    for (int j=std::max(jb,operators[a].symmetric? i : 0); 
+			    j<jend; j++)
+			r[i*m+j]=dotRows(o+i*n, &tmp[(j-jb)*n], n);
+	    }
+	}
+    }
+
+    for (size_t a=0; a<operators.size(); a++)
+	if (operators[a].symmetric)
+	{
+	    double* r=operators[a].result->data();
+	    for (int i=0; i<m; i++)
+		for (int j=0; j<i; j++)
+		    r[i*m+j]=r[j*m+i];
+	}
+}
+
+/**
+ * @brief Copies the lower triangle of a row-major square matrix to the
+ * upper one
+ */
+static void mirrorLowerTriangle(blitz::Array<double,2>& result)
+{
+    const int n=result.rows();
+    double* c=result.data();
+    for (int i=0; i<n; i++)
+      for (int j=0; j<i; j++)
+	c[j*n+i]=c[i*n+j];
+}
+
 /**
  * @brief A function to calculate the reduced density matrix 
  *
@@ -57,44 +195,146 @@ blitz::Array<double,2> transformOperator(const blitz::Array<double,2>& op,
  *
  * @return a matrix with the reduced density matrix
  *
- * The wavefunction has to be written as a matrix.
+ * The wavefunction has to be written as a matrix. The density matrix is
+ * psi*psi^T, which is symmetric, so only its lower triangle is calculated
+ * and then copied to the upper one.
+ *
+ */
+blitz::Array<double,2> calculateReducedDensityMatrix(
+	const blitz::Array<double,2>& psi)
+{
+    blitz::MemoryTagScope memoryTag(DENSITY_MATRIX_MEMORY);
+    blitz::Array<double,2> result(psi.rows(), psi.rows());
+    result=0.0;
+
+    linearAlgebra().syrk(1.0, psi, result);
+    mirrorLowerTriangle(result);
+
+    return result;
+}
+
+/**
+ * @brief A function to calculate the reduced density matrix for several
+ * target states
+ *
+ * @param psis the wavefunctions, written as matrices
+ * @param weights the weight of each wavefunction in the mixture. They
+ * must be positive and add up to one.
+ *
+ * @return a matrix with the reduced density matrix
  *
+ * The density matrix is \f$ \sum_n w_n \psi_n\psi_n^T \f$. Truncating
+ * with it keeps a basis that represents all the targets reasonably well.
  */
-blitz::Array<double,2> calculateReducedDensityMatrix(blitz::Array<double,2> psi)
+blitz::Array<double,2> calculateReducedDensityMatrix(
+	const std::vector<blitz::Array<double,2> >& psis, 
+	const std::vector<double>& weights)
 {
-    int rows_psi=psi.rows();
-    int cols_psi=psi.cols();
+    blitz::MemoryTagScope memoryTag(DENSITY_MATRIX_MEMORY);
+    if (psis.empty() || psis.size()!=weights.size())
+	throw dmrg::Exception("calculateReducedDensityMatrix: wrong weights");
 
-    blitz::Array<double,2> result(rows_psi, rows_psi);
+    blitz::Array<double,2> result(psis[0].rows(), psis[0].rows());
     result=0.0;
 
-    for (int i=0; i<rows_psi; i++)
-      for (int j=0; j<rows_psi; j++)
-        for (int k=0; k<cols_psi; k++)
- 	  result(i,j) += psi(i,k)*psi(j,k); 
+    for (size_t n=0; n<psis.size(); n++)
+	linearAlgebra().syrk(weights[n], psis[n], result);
+    mirrorLowerTriangle(result);
 
     return result;
 }
 
+/**
+ * @brief A function to add White's perturbation to the reduced density
+ * matrix
+ *
+ * @param density_matrix the reduced density matrix, modified on return
+ * @param psi the wavefunction used to calculate the density matrix
+ * @param operators the operators of the system block that couple it to
+ * the rest of the chain
+ * @param amplitude the strength of the perturbation
+ *
+ * Replaces the density matrix by
+ * \f$ (\rho + a \sum_A A\rho A^\dagger)/(1+a \sum_A |A\psi|^2) \f$
+ * (S. R. White, PRB 72, 180403 (2005)). The extra terms mix into the kept
+ * basis the states that the block operators reach from psi, which helps
+ * the finite system algorithm out of metastable states when m is fixed.
+ * As the amplitude goes to zero you recover the original density matrix.
+ */
+void addDensityMatrixCorrection(blitz::Array<double,2>& density_matrix,
+	const blitz::Array<double,2>& psi,
+	const std::vector<blitz::Array<double,2> >& operators, double amplitude)
+{
+    addDensityMatrixCorrection(density_matrix, 
+	    std::vector<blitz::Array<double,2> >(1, psi),
+	    std::vector<double>(1, 1.0), operators, amplitude);
+}
+
+/**
+ * @brief Same as above when the density matrix is a mixture of several
+ * target states
+ *
+ * @param density_matrix the reduced density matrix, modified on return
+ * @param psis the wavefunctions used to calculate the density matrix
+ * @param weights the weight of each wavefunction in the density matrix
+ * @param operators the operators of the system block that couple it to
+ * the rest of the chain
+ * @param amplitude the strength of the perturbation
+ */
+void addDensityMatrixCorrection(blitz::Array<double,2>& density_matrix,
+	const std::vector<blitz::Array<double,2> >& psis, 
+	const std::vector<double>& weights,
+	const std::vector<blitz::Array<double,2> >& operators, double amplitude)
+{
+    blitz::MemoryTagScope memoryTag(DENSITY_MATRIX_MEMORY);
+    if (amplitude<=0.0) return;
+
+    const int n=density_matrix.rows();
+    blitz::Array<double,2> correction(n,n);
+    correction=0.0;
+
+    double norm=1.0;
+    for (size_t t=0; t<psis.size(); t++)
+    {
+	const blitz::Array<double,2>& psi=psis[t];
+	blitz::Array<double,2> op_psi(n, psi.cols());
+	for (size_t a=0; a<operators.size(); a++)
+	{
+	    if (operators[a].cols()!=psi.rows())
+		throw dmrg::Exception("addDensityMatrixCorrection: wrong dims");
+	    linearAlgebra().gemm(false, false, 1.0, operators[a], psi, 0.0, 
+		    op_psi);
+	    linearAlgebra().syrk(amplitude*weights[t], op_psi, correction);
+	    norm+=amplitude*weights[t]*sum(op_psi*op_psi);
+	}
+    }
+    mirrorLowerTriangle(correction);
+
+    density_matrix=(density_matrix+correction)/norm;
+}
+
 /**
  * @brief A function calculate the density matrix eigenvalues
  *
  * @param density_matrix the reduced density matrix
  * @param m number of density matrix eigenvalues to keep
+ * @param truncation_error if not null, on return, the sum of the
+ * eigenvalues thrown away
  *
  * @return truncated_density_matrix the truncated reduced density matrix
  *
  * Takes the reduced density matrix (DM) which is a real and symmetric 
- * matrix. Performs a Householder reduction to tridiagonal form, then 
- * diagonalizes exactly this matrix. Takes input as Blitz++ arrays 
+ * matrix. Diagonalizes it exactly with diagonalizeDensityMatrix(). Takes
+ * input as Blitz++ arrays
  *
  * Checks if the DM is square (but not if it's symmetric), and that
  * mm=<nn. Assures that the sum of the DM eigenvalues is 1.0
  *
  */
 blitz::Array<double,2> truncateReducedDM(blitz::Array<double,2>& 
-	density_matrix, int m)
+	density_matrix, int m, double* truncation_error)
 {
+    blitz::MemoryTagScope memoryTag(DENSITY_MATRIX_MEMORY);
     if (density_matrix.cols()!=density_matrix.rows())
 	throw dmrg::Exception("reduced DM is not square");
     
@@ -115,9 +355,9 @@ blitz::Array<double,2> truncateReducedDM(blitz::Array<double,2>&
     blitz::Array<int,1> indexes=
 	orderDensityMatrixEigenvalues(density_matrix_eigenvalues);
 
-    // calculate and print the truncation error
-    //std::cout<<std::setprecision(16)<<"truncation_error ";
-    //std::cout<<calculateTruncationError(density_matrix_eigenvalues, indexes, mm)<<'\n';
+    if (truncation_error)
+	*truncation_error=calculateTruncationError(density_matrix_eigenvalues,
+		indexes, m);
 
     // define the truncation matrix formed by the eigenvector corresponding 
     // to the largest eigevalues
@@ -189,22 +429,17 @@ blitz::Array<int,1> orderDensityMatrixEigenvalues(
  * On entrace to the function, density_matrix is the reduced density
  * matrix, and density_matrix_eigenvalues can be garbage.
  * On return, density_matrix(j,i) is the eigenvector corresponding to 
- * density_matrix_eigenvalues(i). To diagonalize the density matrix, which
- * is symmetric, you first reduce it to a tridiagonal form using
- * Householder reduction, and then diagonalize this tridiagonal matrix. 
+ * density_matrix_eigenvalues(i). The density matrix is symmetric, so it
+ * is diagonalized by the symmetric eigensolver of the linear algebra
+ * backend (see LinearAlgebraBackend): the reference one reduces it to a
+ * tridiagonal form using Householder reduction, and then diagonalizes
+ * this tridiagonal matrix. 
  */
 void diagonalizeDensityMatrix(blitz::Array<double,2>& 
 	density_matrix, blitz::Array<double,1>& density_matrix_eigenvalues)
 {
-    const int n=density_matrix.rows();
-    // temporary array
-    blitz::Array<double,1> e(n);
-
-    // reduce symmetric matrix to a tridiagonal form (Householder reduct.)
-    tred3(density_matrix, density_matrix_eigenvalues, e, n);
-
-    // diagonalizes a tridiagonal matrix
-    int rtn = tqli2(density_matrix_eigenvalues, e, n, density_matrix, 1);
+    linearAlgebra().symmetricEigensystem(density_matrix, 
+	    density_matrix_eigenvalues);
 } 
 /**
  * @brief A function to calculate the truncation error
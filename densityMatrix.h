@@ -13,16 +13,52 @@
 #ifndef DENSITY_MATRIX_H
 #define DENSITY_MATRIX_H  
 
+#include <vector>
 #include "blitz/array.h"
 
+/**
+ * @brief An operator to transform to the new basis with
+ * transformOperators(), and where to store the result
+ */
+struct OperatorTransform
+{
+    /// the operator in the old basis
+    const blitz::Array<double,2>* op;
+    /// the operator in the new basis, resized if needed
+    blitz::Array<double,2>* result;
+    /// true if op is symmetric, then only half of the result is calculated
+    bool symmetric;
+
+    OperatorTransform(const blitz::Array<double,2>& op_, 
+	    blitz::Array<double,2>& result_, bool symmetric_)
+	: op(&op_), result(&result_), symmetric(symmetric_) {}
+};
+
+void transformOperators(std::vector<OperatorTransform>& operators, 
+	const blitz::Array<double,2>& transformation_matrix);
+
 blitz::Array<double,2> transformOperator(const blitz::Array<double,2>& op, 
 	const blitz::Array<double,2>& transposed_transformation_matrix,
 	const blitz::Array<double,2>& transformation_matrix);
 
-blitz::Array<double,2> calculateReducedDensityMatrix(blitz::Array<double,2> psi);
+blitz::Array<double,2> calculateReducedDensityMatrix(
+	const blitz::Array<double,2>& psi);
+
+blitz::Array<double,2> calculateReducedDensityMatrix(
+	const std::vector<blitz::Array<double,2> >& psis, 
+	const std::vector<double>& weights);
+
+void addDensityMatrixCorrection(blitz::Array<double,2>& density_matrix,
+	const blitz::Array<double,2>& psi,
+	const std::vector<blitz::Array<double,2> >& operators, double amplitude);
+
+void addDensityMatrixCorrection(blitz::Array<double,2>& density_matrix,
+	const std::vector<blitz::Array<double,2> >& psis, 
+	const std::vector<double>& weights,
+	const std::vector<blitz::Array<double,2> >& operators, double amplitude);
 
 blitz::Array<double,2> truncateReducedDM(blitz::Array<double,2>& density_matrix, 
-	const int mm);
+	const int mm, double* truncation_error=0);
 
 void diagonalizeDensityMatrix(blitz::Array<double,2>& 
 	density_matrix, blitz::Array<double,1>& density_matrix_eigenvalues);
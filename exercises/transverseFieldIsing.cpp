@@ -25,6 +25,7 @@
 #include "lanczosDMRG.h"
 #include "densityMatrix.h"
 #include "main_helpers.h"
+#include "siteOperators.h"
 
 int main()
 {
@@ -45,58 +46,59 @@ int main()
     Block system;   //create the system block
     Block env;  //create the environment block
 
-    //Below we declare the Blitz++ matrices used by the program
-    blitz::Array<double,4> TSR(2,2,2,2);   //tensor product for Hab hamiltonian
+    // the number of states of a site: the kernels are specialized for it
+    const int d=2;
 
-    blitz::Array<double,4> Habcd(4,4,4,4); // superblock hamiltonian
-    blitz::Array<double,2> Psi(4,4);       // ground state wavefunction
-    blitz::Array<double,2> reducedDM(4,4); // reduced density matrix
-    blitz::Array<double,2> OO(m,4);        // the truncation matrix
-    blitz::Array<double,2> OT(4,m);        // transposed truncation matrix
+    //Below we declare the Blitz++ matrices used by the program
+    blitz::Array<double,4> Habcd(d*d,d*d,d*d,d*d); // superblock hamiltonian
+    blitz::Array<double,2> Psi(d*d,d*d);      // ground state wavefunction
+    blitz::Array<double,2> reducedDM(d*d,d*d); // reduced density matrix
+    blitz::Array<double,2> OO(m,d*d);      // the truncation matrix
+    blitz::Array<double,2> OT(d*d,m);      // transposed truncation matrix
 
     blitz::Array<double,2> blockH_p;       //block hamiltonian after transform.
     blitz::Array<double,2> S_z_p;          //S_z operator after transformation  
     blitz::Array<double,2> S_x_p;          //S_x operator after transformation
 
-    // create the pauli matrices and the 2x2 identity matrix
-    blitz::Array<double,2> sigma_z(2,2), sigma_x(2,2);
+    // create the spin operators and the identity of a spin-1/2 site
+    SiteOperator<d> sigma_z, sigma_x;
     sigma_z = 0.5, 0,
          0, -0.5;
     sigma_x = 0, 1.0,
          1.0, 0;
-    blitz::Array<double,2> I2=createIdentityMatrix(2);
-
-    // declare tensor indices according to Blitz++ convention
-    blitz::firstIndex i;    blitz::secondIndex j; 
-    blitz::thirdIndex k;    blitz::fourthIndex l; 
-
-    // build the Hamiltonian for two-sites only
-    TSR = sigma_x(i,k)*sigma_x(j,l)+ h*sigma_z(i,k)*I2(j,l) + 
-	h*I2(i,k)*sigma_z(j,l);
-    system.blockH.resize(4,4);
-    system.blockH = reduceM2M2(TSR);
-
-    TSR = sigma_z(i,k)*I2(j,l);
-    blitz::Array<double,2> S_z = reduceM2M2(TSR);
-
-    TSR = sigma_x(i,k)*I2(j,l);
-    blitz::Array<double,2> S_x = reduceM2M2(TSR);
+    SiteOperator<d> I2=siteIdentity<d>();
+
+    // the terms of the last sites of the two enlarged blocks of the
+    // superblock: their coupling and the field on both
+    std::vector<SiteCoupling<d> > siteCouplings;
+    siteCouplings.push_back(SiteCoupling<d>(1.0, sigma_x, sigma_x));
+    siteCouplings.push_back(SiteCoupling<d>(h, sigma_z, I2));
+    siteCouplings.push_back(SiteCoupling<d>(h, I2, sigma_z));
+
+    // build the Hamiltonian for two-sites only: a block of one site plus
+    // a site
+    std::vector<SiteProduct<d> > twoSites;
+    twoSites.push_back(SiteProduct<d>(1.0, siteOperatorMatrix(sigma_x), sigma_x));
+    twoSites.push_back(SiteProduct<d>(h, siteOperatorMatrix(sigma_z), I2));
+    twoSites.push_back(SiteProduct<d>(h, sigma_z));
+    enlargeBlock(system.blockH, d, twoSites);
+
+    // the operators of the last site of the block
+    blitz::Array<double,2> S_z, S_x;
+    enlargeBlock(S_z, d, SiteProduct<d>(1.0, sigma_z));
+    enlargeBlock(S_x, d, SiteProduct<d>(1.0, sigma_x));
     // done building the Hamiltonian
 
     /**
      * Infinite system algorithm: build the Hamiltonian from 2 to N-sites
      */
-    int statesToKeep=2;      //start with a 2^2=4 state system
+    int statesToKeep=d;      //start with a d^2 state system
     int sitesInSystem=2;     //# sites in the system block
 
-    blitz::Array<double,2> I2st=createIdentityMatrix(4);
-
     while (sitesInSystem <= (numberOfSites)/2 ) 
     {
 	// build the hamiltonian as a four-index tensor
-        Habcd = system.blockH(i,k)*I2st(j,l)+ 
-            I2st(i,k)*system.blockH(j,l)+
-            S_x(i,k)*S_x(j,l)+h*S_z(i,k)*I2st(j,l)+h*I2st(i,k)*S_z(j,l);
+        buildSuperblock(Habcd, system.blockH, system.blockH, siteCouplings);
 
 	// calculate the ground state energy 
         double groundStateEnergy=calculateGroundState(Habcd, Psi);
@@ -104,52 +106,35 @@ int main()
         printGroundStateEnergy(sitesInSystem, sitesInSystem, groundStateEnergy);
 
 	// increase the number of states if you are not at m yet
-        statesToKeep= (2*statesToKeep<=m)? 2*statesToKeep : m;
+        statesToKeep= (d*statesToKeep<=m)? d*statesToKeep : m;
 
-        // calculate the reduced density matrix and truncate 
+        // calculate the reduced density matrix and truncate. The results
+        // are moved into reducedDM and OO, not copied
         reducedDM=calculateReducedDensityMatrix(Psi);
 
-        OO.resize(statesToKeep,reducedDM.rows()); //resize transf. matrix
-        OT.resize(reducedDM.rows(),statesToKeep); // and its inverse
+        OT.resize(reducedDM.rows(),statesToKeep); //resize the inverse
         OO=truncateReducedDM(reducedDM, statesToKeep); //get transf. matrix 
         OT=OO.transpose(blitz::secondDim, blitz::firstDim); //and its inverse
 
         //transform the operators to new basis
-        blockH_p.resize(statesToKeep, statesToKeep);
-        S_z_p.resize(statesToKeep, statesToKeep);
-        S_x_p.resize(statesToKeep, statesToKeep);
         blockH_p=transformOperator(system.blockH, OT, OO);
         S_z_p=transformOperator(S_z, OT, OO);
         S_x_p=transformOperator(S_x, OT, OO);
-    
-	blitz::Array<double,2> Iss=createIdentityMatrix(statesToKeep);
 
         //Hamiltonian for next iteration
-        TSR.resize(statesToKeep,2,statesToKeep,2);
-        TSR = blockH_p(i,k)*I2(j,l) + S_x_p(i,k)*sigma_x(j,l)+ 
-            h*Iss(i,k)*sigma_z(j,l);
-
-        system.blockH.resize(2*statesToKeep,2*statesToKeep);            
-        system.blockH = reduceM2M2(TSR);
-
-	//redefine identity matrix
-	int statesToKeepNext= (2*statesToKeep<=m)? 4*statesToKeep : 2*m;
-	I2st.resize(statesToKeepNext, statesToKeepNext);    
-	I2st = createIdentityMatrix(statesToKeepNext);
+        std::vector<SiteProduct<d> > enlargedH;
+        enlargedH.push_back(SiteProduct<d>(1.0, blockH_p, I2));
+        enlargedH.push_back(SiteProduct<d>(1.0, S_x_p, sigma_x));
+        enlargedH.push_back(SiteProduct<d>(h, sigma_z));
+        enlargeBlock(system.blockH, statesToKeep, enlargedH);
 
 	//redefine the operators for next iteration
-	S_z.resize(2*statesToKeep,2*statesToKeep);  
-	TSR = I2st(i,k)*sigma_z(j,l);
-	S_z = reduceM2M2(TSR);
-
-	S_x.resize(2*statesToKeep,2*statesToKeep);
-	TSR = I2st(i,k)*sigma_x(j,l);
-	S_x = reduceM2M2(TSR);
+	enlargeBlock(S_z, statesToKeep, SiteProduct<d>(1.0, sigma_z));
+	enlargeBlock(S_x, statesToKeep, SiteProduct<d>(1.0, sigma_x));
 
-	// re-prepare superblock matrix, wavefunction and reduced DM
-	Habcd.resize(2*statesToKeep,2*statesToKeep,2*statesToKeep,2*statesToKeep);   
-	Psi.resize(2*statesToKeep,2*statesToKeep);             
-	reducedDM.resize(2*statesToKeep,2*statesToKeep);
+	// re-prepare superblock matrix and wavefunction
+	Habcd.resize(d*statesToKeep,d*statesToKeep,d*statesToKeep,d*statesToKeep);   
+	Psi.resize(d*statesToKeep,d*statesToKeep);             
 
 	// make the system one site larger and save it
         system.size = ++sitesInSystem;  
@@ -169,8 +154,6 @@ int main()
         // start in the middle of the chain 
         int sitesInSystem = numberOfSites/2;
         system.FSAread(sitesInSystem,1);
-	
-	blitz::Array<double,2> Im=createIdentityMatrix(2*m);
 
         for (int halfSweep=0; halfSweep<numberOfHalfSweeps; halfSweep++)
         {
@@ -182,10 +165,8 @@ int main()
                 env.FSAread(sitesInEnviroment,halfSweep);
 
                 // build the hamiltonian as a four-index tensor
-                Habcd = env.blockH(i,k)*I2st(j,l)+
-		    I2st(i,k)*system.blockH(j,l)+
-                    S_x(i,k)*S_x(j,l)+
-                    h*S_z(i,k)*Im(j,l)+h*Im(i,k)*S_z(j,l);
+                buildSuperblock(Habcd, env.blockH, system.blockH,
+                        siteCouplings);
 
                 // calculate the ground state energy 
                 double groundStateEnergy=calculateGroundState(Habcd, Psi);
@@ -209,9 +190,11 @@ int main()
                 S_x_p=transformOperator(S_x, OT, OO);
 
                 // add spin to the system block only
-                TSR = blockH_p(i,k)*I2(j,l) + S_x_p(i,k)*sigma_x(j,l)+ 
-                    h*Im(i,k)*sigma_z(j,l);       
-                system.blockH = reduceM2M2(TSR);
+                std::vector<SiteProduct<d> > enlargedH;
+                enlargedH.push_back(SiteProduct<d>(1.0, blockH_p, I2));
+                enlargedH.push_back(SiteProduct<d>(1.0, S_x_p, sigma_x));
+                enlargedH.push_back(SiteProduct<d>(h, sigma_z));
+                enlargeBlock(system.blockH, blockH_p.rows(), enlargedH);
 
                 sitesInSystem++;
 
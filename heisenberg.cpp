@@ -17,19 +17,63 @@
  *  up the chain
  *  <li> After this, a number of finite system algorithm sweeps are performed
  *  <li> The exact diagonalization performed with Lanczos
- *  <li> The output is the energy as a function of sweep
+ *  <li> The output is the energy as a function of sweep. Optionally, the
+ *  energy, truncation error and timings of each step are also streamed
+ *  to a results file
+ *  <li> Optionally, several of the lowest states can be targeted at
+ *  once, and the gaps to the ground state are printed after its energy
+ *  <li> Optionally, White's perturbation is added to the density matrix
+ *  during the sweeps (see parseRunOptions())
+ *  <li> Optionally, the run is checkpointed during the sweeps and can be
+ *  resumed from the last checkpoint
+ *  <li> Optionally, the ground state is saved at the end as a matrix
+ *  product state
  *  <li> The code uses Blitz++ to handle tensors and matrices: see http://www.oonumerics.org/blitz/
  *  </ul>
  */
+#include <cstdio>
+#include <memory>
 #include "blitz/array.h"
+#include "arrayPool.h"
 #include "block.h"
+#include "checkpoint.h"
 #include "matrixManipulation.h"
 #include "lanczosDMRG.h"
+#include "linearAlgebra.h"
 #include "densityMatrix.h"
 #include "main_helpers.h"
+#include "mps.h"
+#include "results.h"
+#include "memoryUsage.h"
+#include "siteOperators.h"
 
-int main()
+int main(int argc, char* argv[])
 {
+    RunOptions options=parseRunOptions(argc, argv);
+
+    // the memory of the arrays is reused from one step to the next, and
+    // aligned either way. The allocators go first, and they are static,
+    // so they outlive all the arrays, also those kept in statics like the
+    // Lanczos workspace
+    static ArrayPool arrayPool(4096, options.hugePages);
+    static AlignedAllocator alignedAllocator(options.hugePages);
+    if (options.arrayPool)
+        arrayPool.install();
+    else
+        blitz::setMemoryBlockAllocator(&alignedAllocator);
+
+    // the dense linear algebra is done by the default backend of the
+    // build, unless another one is asked for
+    if (!options.linearAlgebra.empty())
+    {
+        LinearAlgebraBackend* backend=
+            findLinearAlgebraBackend(options.linearAlgebra);
+        if (!backend)
+            throw dmrg::Exception("no "+options.linearAlgebra+
+                    " linear algebra in this build (see make lapack=1)");
+        setLinearAlgebraBackend(*backend);
+    }
+
     // Read some input from user
     int numberOfHalfSweeps;
     int numberOfSites;    
@@ -41,132 +85,169 @@ int main()
     std::cout<<"Enter the number of FSA sweeps : ";
     std::cin>>numberOfHalfSweeps;
 
-    Block system;   //create the system block
-    Block env;  //create the environment block
+    if (options.estimateMemory)
+    {
+        printMemoryUsage(std::cout, "estimated memory of the arrays",
+                estimateMemoryUsage(m, numberOfSites, options.targets,
+                    options.blockMemory));
+        return 0;
+    }
+
+    // the arrays of main are the operators of the blocks, unless they are
+    // tagged otherwise. The memory of each step goes to its record, and
+    // the peaks of the whole run to runMemory
+    blitz::MemoryTagScope memoryTag(BLOCK_OPERATOR_MEMORY);
+    MemoryUsage runMemory;
+
+    // blocks are kept in memory up to blockMemory MB, then spilled to disk
+    BlockStore blockStore(size_t(options.blockMemory*1024*1024), 
+            options.scratch, options.mapBlocks, options.writeQueue,
+            BlockCompression(options.compress, options.compressThreshold));
+    // where the results of each step go, if anywhere. A resumed run adds
+    // its steps to those of the run it resumes
+    std::unique_ptr<ResultsSink> results;
+    if (!options.results.empty())
+        results.reset(new ResultsSink(options.results, 
+                    options.resultsFormat=="binary"? ResultsSink::BINARY :
+                    ResultsSink::JSON_LINES, options.restart));
+    Block system(blockStore);   //create the system block
+    Block env(blockStore);  //create the environment block
+
+    // the number of states of a site: the kernels are specialized for it
+    const int d=2;
 
     //Below we declare the Blitz++ matrices used by the program
-    blitz::Array<double,4> TSR(2,2,2,2);   //tensor product for Hab hamiltonian
-
-    blitz::Array<double,4> Habcd(4,4,4,4); // superblock hamiltonian
-    blitz::Array<double,2> Psi(4,4);       // ground state wavefunction
-    blitz::Array<double,2> reducedDM(4,4); // reduced density matrix
-    blitz::Array<double,2> OO(m,4);        // the truncation matrix
-    blitz::Array<double,2> OT(4,m);        // transposed truncation matrix
+    blitz::Array<double,4> Habcd(d*d,d*d,d*d,d*d); // superblock hamiltonian
+    // target wavefunctions: Psi[0] is the ground state, the rest are the
+    // lowest excited states. All have the same weight in the density matrix
+    std::vector<blitz::Array<double,2> > Psi(options.targets);
+    std::vector<double> weights(options.targets, 1.0/options.targets);
+    std::vector<double> energies(options.targets);
+    // the blocks of the last superblock: the targets are Psi(system,env)
+    int sitesInLeft=0, sitesInRight=0;
+    bool systemOnLeft=true;
+    blitz::Array<double,2> reducedDM(d*d,d*d); // reduced density matrix
+    blitz::Array<double,2> OO(m,d*d);      // the truncation matrix
 
     blitz::Array<double,2> blockH_p;       //block hamiltonian after transform.
     blitz::Array<double,2> S_z_p;          //S_z operator after transformation  
-    blitz::Array<double,2> S_m_p;          //S_m operator after transformation
     blitz::Array<double,2> S_p_p;          //S_p operator after transformation
+    // S_m operators are never stored: S_m=hermitianConjugate(S_p)
 
-    // create the pauli matrices and the 2x2 identity matrix
-    blitz::Array<double,2> sigma_z(2,2), sigma_p(2,2), sigma_m(2,2);
+    // create the spin operators and the identity of a spin-1/2 site
+    SiteOperator<d> sigma_z, sigma_p;
     sigma_z = 0.5, 0,
          0, -0.5;
     sigma_p = 0, 1.0,
          0, 0;
-    sigma_m = 0, 0,
-         1.0, 0;
-    blitz::Array<double,2> I2=createIdentityMatrix(2);
-
-    // declare tensor indices according to Blitz++ convention
-    blitz::firstIndex i;    blitz::secondIndex j; 
-    blitz::thirdIndex k;    blitz::fourthIndex l; 
-
-    // build the Hamiltonian for two-sites only
-    TSR = sigma_z(i,k)*sigma_z(j,l)+ 0.5*sigma_p(i,k)*sigma_m(j,l) + 
-	0.5*sigma_m(i,k)*sigma_p(j,l);
-    system.blockH.resize(4,4);
-    system.blockH = reduceM2M2(TSR);
-
-    TSR = sigma_z(i,k)*I2(j,l);
-    blitz::Array<double,2> S_z = reduceM2M2(TSR);
-
-    TSR = sigma_m(i,k)*I2(j,l);
-    blitz::Array<double,2> S_m = reduceM2M2(TSR);
-
-    TSR = sigma_p(i,k)*I2(j,l);
-    blitz::Array<double,2> S_p = reduceM2M2(TSR);
+    SiteOperator<d> sigma_m=hermitianConjugate(sigma_p);
+    SiteOperator<d> I2=siteIdentity<d>();
+
+    // the interaction between the last sites of the two enlarged blocks
+    // of the superblock: S^z S^z + (S^+ S^- + S^- S^+)/2
+    std::vector<SiteCoupling<d> > siteCouplings;
+    siteCouplings.push_back(SiteCoupling<d>(1.0, sigma_z, sigma_z));
+    siteCouplings.push_back(SiteCoupling<d>(0.5, sigma_p, sigma_m));
+    siteCouplings.push_back(SiteCoupling<d>(0.5, sigma_m, sigma_p));
+
+    // build the Hamiltonian for two-sites only: a block of one site plus
+    // a site
+    std::vector<SiteProduct<d> > twoSites;
+    twoSites.push_back(SiteProduct<d>(1.0, siteOperatorMatrix(sigma_z), sigma_z));
+    twoSites.push_back(SiteProduct<d>(0.5, siteOperatorMatrix(sigma_p), sigma_m));
+    twoSites.push_back(SiteProduct<d>(0.5, siteOperatorMatrix(sigma_m), sigma_p));
+    enlargeBlock(system.blockH, d, twoSites);
+
+    // the operators of the last site of the block
+    blitz::Array<double,2> S_z, S_p;
+    enlargeBlock(S_z, d, SiteProduct<d>(1.0, sigma_z));
+    enlargeBlock(S_p, d, SiteProduct<d>(1.0, sigma_p));
     // done building the Hamiltonian
 
     /**
      * Infinite system algorithm: build the Hamiltonian from 2 to N-sites
      */
-    int statesToKeep=2;      //start with a 2^2=4 state system
+    int statesToKeep=d;      //start with a d^2 state system
     int sitesInSystem=2;     //# sites in the system block
 
-    blitz::Array<double,2> I2st=createIdentityMatrix(4);
-
-    while (sitesInSystem <= (numberOfSites)/2 ) 
+    // when resuming a run, the checkpoint has the blocks already
+    while (!options.restart && sitesInSystem <= (numberOfSites)/2 ) 
     {
+        StepRecord stepRecord;
+        double stepStart=wallTime();
+
 	// build the hamiltonian as a four-index tensor
-        Habcd = system.blockH(i,k)*I2st(j,l)+ 
-            I2st(i,k)*system.blockH(j,l)+
-            S_z(i,k)*S_z(j,l)+0.5*S_p(i,k)*S_m(j,l)+0.5*S_m(i,k)*S_p(j,l);
+        buildSuperblock(Habcd, system.blockH, system.blockH, siteCouplings);
 
-	// calculate the ground state energy 
-        double groundStateEnergy=calculateGroundState(Habcd, Psi);
+	// calculate the energies of the target states
+        calculateLowestStates(Habcd, Psi, energies, 
+                &stepRecord.lanczosIterations);
+        stepRecord.lanczosSeconds=wallTime()-stepStart;
 
-        printGroundStateEnergy(sitesInSystem, sitesInSystem, groundStateEnergy);
+        printTargetEnergies(sitesInSystem, sitesInSystem, energies);
+        sitesInLeft=sitesInRight=sitesInSystem;
 
 	// increase the number of states if you are not at m yet
-        statesToKeep= (2*statesToKeep<=m)? 2*statesToKeep : m;
+        statesToKeep= (d*statesToKeep<=m)? d*statesToKeep : m;
 
-        // calculate the reduced density matrix and truncate 
-        reducedDM=calculateReducedDensityMatrix(Psi);
+        // calculate the reduced density matrix and truncate. The results
+        // are moved into reducedDM and OO, not copied
+        reducedDM=calculateReducedDensityMatrix(Psi, weights);
 
-        OO.resize(statesToKeep,reducedDM.rows()); //resize transf. matrix
-        OT.resize(reducedDM.rows(),statesToKeep); // and its inverse
-        OO=truncateReducedDM(reducedDM, statesToKeep); //get transf. matrix 
-        OT=OO.transpose(blitz::secondDim, blitz::firstDim); //and its inverse
+        OO=truncateReducedDM(reducedDM, statesToKeep, //get transf. matrix 
+                &stepRecord.truncationError);
+        stepRecord.truncationSeconds=
+            wallTime()-stepStart-stepRecord.lanczosSeconds;
+        system.ISAwriteTransformation(sitesInSystem, OO);
 
         //transform the operators to new basis
-        blockH_p.resize(statesToKeep, statesToKeep);
-        S_z_p.resize(statesToKeep, statesToKeep);
-        S_p_p.resize(statesToKeep, statesToKeep);
-        S_m_p.resize(statesToKeep, statesToKeep);
-        blockH_p=transformOperator(system.blockH, OT, OO);
-        S_z_p=transformOperator(S_z, OT, OO);
-        S_p_p=transformOperator(S_p, OT, OO);
-        S_m_p=transformOperator(S_m, OT, OO);
+        std::vector<OperatorTransform> blockOperators;
+        blockOperators.push_back(OperatorTransform(system.blockH,blockH_p,true));
+        blockOperators.push_back(OperatorTransform(S_z, S_z_p, true));
+        blockOperators.push_back(OperatorTransform(S_p, S_p_p, false));
+        transformOperators(blockOperators, OO);
 
         //Hamiltonian for next iteration
-        TSR.resize(statesToKeep,2,statesToKeep,2);
-        TSR = blockH_p(i,k)*I2(j,l) + S_z_p(i,k)*sigma_z(j,l)+ 
-            0.5*S_p_p(i,k)*sigma_m(j,l) + 0.5*S_m_p(i,k)*sigma_p(j,l) ;
-
-        system.blockH.resize(2*statesToKeep,2*statesToKeep);            
-        system.blockH = reduceM2M2(TSR);
-
-	//redefine identity matrix
-	int statesToKeepNext= (2*statesToKeep<=m)? 4*statesToKeep : 2*m;
-	I2st.resize(statesToKeepNext, statesToKeepNext);    
-	I2st = createIdentityMatrix(statesToKeepNext);
+        std::vector<SiteProduct<d> > enlargedH;
+        enlargedH.push_back(SiteProduct<d>(1.0, blockH_p, I2));
+        enlargedH.push_back(SiteProduct<d>(1.0, S_z_p, sigma_z));
+        enlargedH.push_back(SiteProduct<d>(0.5, S_p_p, sigma_m));
+        enlargedH.push_back(
+                SiteProduct<d>(0.5, hermitianConjugate(S_p_p), sigma_p));
+        enlargeBlock(system.blockH, statesToKeep, enlargedH);
 
 	//redefine the operators for next iteration
-	S_z.resize(2*statesToKeep,2*statesToKeep);  
-	TSR = I2st(i,k)*sigma_z(j,l);
-	S_z = reduceM2M2(TSR);
-
-	S_p.resize(2*statesToKeep,2*statesToKeep);
-	TSR = I2st(i,k)*sigma_p(j,l);
-	S_p = reduceM2M2(TSR);
-
-	S_m.resize(2*statesToKeep,2*statesToKeep);
-	TSR = I2st(i,k)*sigma_m(j,l);
-	S_m = reduceM2M2(TSR);        
+	enlargeBlock(S_z, statesToKeep, SiteProduct<d>(1.0, sigma_z));
+	enlargeBlock(S_p, statesToKeep, SiteProduct<d>(1.0, sigma_p));
 
-	// re-prepare superblock matrix, wavefunction and reduced DM
-	Habcd.resize(2*statesToKeep,2*statesToKeep,2*statesToKeep,2*statesToKeep);   
-	Psi.resize(2*statesToKeep,2*statesToKeep);             
-	reducedDM.resize(2*statesToKeep,2*statesToKeep);
+	// re-prepare superblock matrix
+	{
+	    blitz::MemoryTagScope memoryTag(SUPERBLOCK_MEMORY);
+	    Habcd.resize(d*statesToKeep,d*statesToKeep,d*statesToKeep,
+		    d*statesToKeep);   
+	}
 
 	// make the system one site larger and save it
         system.size = ++sitesInSystem;  
         system.ISAwrite(sitesInSystem);
 
+        stepRecord.memory=currentMemoryUsage(true);
+        runMemory.includePeaks(stepRecord.memory);
+        if (results)
+        {
+            stepRecord.sitesInLeft=sitesInLeft;
+            stepRecord.sitesInRight=sitesInRight;
+            stepRecord.energy=energies[0];
+            stepRecord.keptStates=statesToKeep;
+            stepRecord.stepSeconds=wallTime()-stepStart;
+            results->record(stepRecord);
+        }
+        arrayPool.endStep();
+
     }//end INFINITE SYSTEM ALGORITHM 
 
-    std::cout<<"End of the infinite system algorithm\n";
+    if (!options.restart)
+        std::cout<<"End of the infinite system algorithm\n";
 
     /**
      * Finite size algorithm 
@@ -175,62 +256,212 @@ int main()
         // find minimum size of the enviroment
         int minEnviromentSize=calculateMinEnviromentSize(m,numberOfSites);
 
-        // start in the middle of the chain 
-        int sitesInSystem = numberOfSites/2;
-        system.FSAread(sitesInSystem,1);
+        const std::string checkpointFile=options.scratch+"/checkpoint.dmrg";
+        int sitesInSystem;
+        int firstHalfSweep=0;
+        // amplitude of the density matrix perturbation
+        double noise=options.noise;
+        // steps done since the start (or the restart) of the algorithm
+        int step=0;
+
+        if (options.restart)
+        {
+            // pick up the run where the checkpoint left it
+            Checkpoint checkpoint;
+            readCheckpoint(checkpointFile, checkpoint);
+            if (checkpoint.m!=m || checkpoint.numberOfSites!=numberOfSites ||
+                    checkpoint.targets!=options.targets)
+                throw dmrg::Exception("the checkpoint "+checkpointFile+
+                        " is for a different run");
+            // a run with nothing left to do would remove the checkpoint
+            // and its blocks without writing new ones
+            if (numberOfHalfSweeps<=checkpoint.halfSweep)
+                throw dmrg::Exception("the checkpoint "+checkpointFile+
+                        " is already at the given number of half sweeps");
+            blockStore.restore(checkpoint.blocks);
+            setLanczosRandomState(checkpoint.randomState);
+            system.blockH.reference(checkpoint.systemBlock);
+            S_z.reference(checkpoint.S_z);
+            S_p.reference(checkpoint.S_p);
+            Psi=checkpoint.Psi;
+            sitesInSystem=checkpoint.sitesInSystem;
+            firstHalfSweep=checkpoint.halfSweep;
+            noise=checkpoint.noise;
+            options.noiseDecay=checkpoint.noiseDecay;
+
+            // the operators of the added site give the size of the rest
+            int states=S_z.rows()/d;
+            {
+                blitz::MemoryTagScope memoryTag(SUPERBLOCK_MEMORY);
+                Habcd.resize(d*states,d*states,d*states,d*states);
+            }
+            // no need to save again the checkpoint we just read
+            step=1;
+            if (results)
+                results->markRestart(firstHalfSweep);
+            std::cerr<<"resuming from "<<checkpointFile<<": half sweep "
+                <<firstHalfSweep<<", "<<sitesInSystem<<" sites in the system\n";
+        }
+        else
+        {
+            // start in the middle of the chain 
+            sitesInSystem = numberOfSites/2;
+            system.FSAread(sitesInSystem,1);
+        }
 
-        for (int halfSweep=0; halfSweep<numberOfHalfSweeps; halfSweep++)
+        for (int halfSweep=firstHalfSweep; halfSweep<numberOfHalfSweeps; 
+                halfSweep++)
         {
+            double halfSweepStart=wallTime();
+
             while (sitesInSystem <= numberOfSites-minEnviromentSize)
             {
+                StepRecord stepRecord;
+                double stepStart=wallTime();
+
+                // save everything needed to resume the run from here
+                if (options.checkpoint>0 && step%options.checkpoint==0)
+                {
+                    Checkpoint checkpoint;
+                    checkpoint.m=m;
+                    checkpoint.numberOfSites=numberOfSites;
+                    checkpoint.numberOfHalfSweeps=numberOfHalfSweeps;
+                    checkpoint.targets=options.targets;
+                    checkpoint.noiseDecay=options.noiseDecay;
+                    checkpoint.halfSweep=halfSweep;
+                    checkpoint.sitesInSystem=sitesInSystem;
+                    checkpoint.noise=noise;
+                    checkpoint.systemBlock.reference(system.blockH);
+                    checkpoint.S_z.reference(S_z);
+                    checkpoint.S_p.reference(S_p);
+                    checkpoint.Psi=Psi;
+                    checkpoint.randomState=lanczosRandomState();
+                    checkpoint.blocks=blockStore.checkpoint();
+                    // the records of the steps before it must not be
+                    // lost if the run is killed after it
+                    if (results)
+                        results->flush();
+                    writeCheckpoint(checkpointFile, checkpoint);
+                }
+                step++;
+
                 int sitesInEnviroment = numberOfSites - sitesInSystem;
 
                 // read the environment block from disk
                 env.FSAread(sitesInEnviroment,halfSweep);
 
+                // and start loading the next one while we work on this one
+                if (sitesInSystem < numberOfSites-minEnviromentSize)
+                    env.FSAprefetch(sitesInEnviroment-1,halfSweep);
+                else if (halfSweep+1 < numberOfHalfSweeps)
+                    env.FSAprefetch(numberOfSites-minEnviromentSize,
+                            halfSweep+1);
+
                 // build the hamiltonian as a four-index tensor
-                Habcd = env.blockH(i,k)*I2st(j,l)+
-		    I2st(i,k)*system.blockH(j,l)+
-                    S_z(i,k)*S_z(j,l)+
-                    0.5*S_p(i,k)*S_m(j,l)+0.5*S_m(i,k)*S_p(j,l);
+                buildSuperblock(Habcd, env.blockH, system.blockH,
+                        siteCouplings);
 
-                // calculate the ground state energy 
-                double groundStateEnergy=calculateGroundState(Habcd, Psi);
+                // calculate the energies of the target states
+                calculateLowestStates(Habcd, Psi, energies,
+                        &stepRecord.lanczosIterations);
+                stepRecord.lanczosSeconds=wallTime()-stepStart;
 
-                if (halfSweep%2 == 0) 
-                    printGroundStateEnergy(sitesInSystem, sitesInEnviroment, 
-                            groundStateEnergy);
-                else 
-                    printGroundStateEnergy(sitesInEnviroment, sitesInSystem, 
-                            groundStateEnergy);
+                systemOnLeft=(halfSweep%2 == 0);
+                sitesInLeft=systemOnLeft? sitesInSystem : sitesInEnviroment;
+                sitesInRight=numberOfSites-sitesInLeft;
+                printTargetEnergies(sitesInLeft, sitesInRight, energies);
 
                 // calculate the reduced density matrix and truncate 
-                reducedDM=calculateReducedDensityMatrix(Psi);
-
-                blitz::Array<double,2> OO=truncateReducedDM(reducedDM, m);   
-                OT=OO.transpose(blitz::secondDim, blitz::firstDim);
+                reducedDM=calculateReducedDensityMatrix(Psi, weights);
+
+                if (noise>0.0)
+                {
+                    std::vector<blitz::Array<double,2> > edgeOperators;
+                    edgeOperators.push_back(S_z);
+                    edgeOperators.push_back(S_p);
+                    edgeOperators.push_back(hermitianConjugate(S_p));
+                    addDensityMatrixCorrection(reducedDM, Psi, weights,
+                            edgeOperators, noise);
+                }
+
+                blitz::Array<double,2> OO=truncateReducedDM(reducedDM, m, 
+                        &stepRecord.truncationError);
+                stepRecord.truncationSeconds=
+                    wallTime()-stepStart-stepRecord.lanczosSeconds;
+                system.FSAwriteTransformation(sitesInSystem, halfSweep, OO);
 
                 // transform the operators to new basis
-                blockH_p=transformOperator(system.blockH, OT, OO);
-                S_z_p=transformOperator(S_z, OT, OO);
-                S_p_p=transformOperator(S_p, OT, OO);
-                S_m_p=transformOperator(S_m, OT, OO);
+                std::vector<OperatorTransform> blockOperators;
+                blockOperators.push_back(
+                        OperatorTransform(system.blockH, blockH_p, true));
+                blockOperators.push_back(OperatorTransform(S_z, S_z_p, true));
+                blockOperators.push_back(OperatorTransform(S_p, S_p_p, false));
+                transformOperators(blockOperators, OO);
 
                 // add spin to the system block only
-                TSR = blockH_p(i,k)*I2(j,l) + S_z_p(i,k)*sigma_z(j,l)+ 
-                    0.5*S_p_p(i,k)*sigma_m(j,l) + 0.5*S_m_p(i,k)*sigma_p(j,l);       
-                system.blockH = reduceM2M2(TSR);
+                std::vector<SiteProduct<d> > enlargedH;
+                enlargedH.push_back(SiteProduct<d>(1.0, blockH_p, I2));
+                enlargedH.push_back(SiteProduct<d>(1.0, S_z_p, sigma_z));
+                enlargedH.push_back(SiteProduct<d>(0.5, S_p_p, sigma_m));
+                enlargedH.push_back(SiteProduct<d>(0.5, 
+                            hermitianConjugate(S_p_p), sigma_p));
+                enlargeBlock(system.blockH, blockH_p.rows(), enlargedH);
 
                 sitesInSystem++;
 
                 system.size = sitesInSystem;
                 system.FSAwrite(sitesInSystem,halfSweep);
+
+                stepRecord.memory=currentMemoryUsage(true);
+                runMemory.includePeaks(stepRecord.memory);
+                if (results)
+                {
+                    stepRecord.halfSweep=halfSweep;
+                    stepRecord.sitesInLeft=sitesInLeft;
+                    stepRecord.sitesInRight=sitesInRight;
+                    stepRecord.energy=energies[0];
+                    stepRecord.keptStates=m;
+                    stepRecord.stepSeconds=wallTime()-stepStart;
+                    results->record(stepRecord);
+                }
+                arrayPool.endStep();
             }// while
 
             sitesInSystem = minEnviromentSize;
             system.FSAread(sitesInSystem,halfSweep);
 
+            std::cerr<<"half sweep "<<halfSweep<<": "
+                <<wallTime()-halfSweepStart<<" s, noise "<<noise<<'\n';
+            noise*=options.noiseDecay;
+
         }// for
+
+        // the run is done: the blocks of the checkpoint are removed with
+        // the block store
+        if (options.checkpoint>0 || options.restart)
+            remove(checkpointFile.c_str());
     }  // end of the finite size algorithm
+
+    // put the ground state together from the last superblock
+    if (!options.mps.empty())
+    {
+        if (sitesInLeft+sitesInRight != numberOfSites)
+            throw dmrg::Exception("can't save the ground state: the last "
+                    "superblock is not the whole chain");
+        MatrixProductState groundState=buildMatrixProductState(blockStore, d,
+                sitesInLeft, sitesInRight, 
+                systemOnLeft? Psi[0] : hermitianConjugate(Psi[0]));
+        groundState.energy=energies[0];
+        writeMatrixProductState(options.mps, groundState);
+    }
+
+    if (results)
+        results->flush();
+    blockStore.flush();
+    blockStore.printStatistics(std::cerr);
+    if (options.arrayPool)
+        arrayPool.printStatistics(std::cerr);
+    runMemory.includePeaks(currentMemoryUsage(false));
+    printMemoryUsage(std::cerr, "memory of the arrays", runMemory);
     return 0;
 } // end main
@@ -11,11 +11,14 @@
  */
 #include <cmath>
 #include <iomanip>
+#include <sstream>
 #include "blitz/array.h"
 #include "exceptions.h"
 #include "lanczosDMRG_helpers.h"
 #include "tqli2.h"
+#include "linearAlgebra.h"
 #include "matrixManipulation.h"
+#include "memoryUsage.h"
 #include "lanczosDMRG.h"
 
 /**
@@ -24,6 +27,9 @@
  * @param Ham a matrix with the Hamiltonian
  * @param Psi an array with the ground state wavefunction
  * @param En a pointer to a double with the ground state energy
+ * @param lowerStates eigenstates of Ham already found (can be empty)
+ * @param iterations if not null, on return, the number of Lanczos
+ * iterations needed to converge the energy
  *
  * @return a int with a code for good/bad termination
  *
@@ -32,8 +38,15 @@
  * stored in the parameter Psi), and an ground state energy (which is
  * stored in the parameter En. When you call the funnction Psi
  * contains garbage, on return it stores the ground state wavefunction.
+ *
+ * If lowerStates is not empty, the Lanczos vectors are kept orthogonal
+ * to them, so you get the lowest eigenstate of Ham in the subspace
+ * orthogonal to lowerStates, i.e. the next excited state.
  */
-int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, blitz::Array<double,1>& Psi, double *En)
+int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, 
+	blitz::Array<double,1>& Psi, double *En,
+	const std::vector<blitz::Array<double,1> >& lowerStates, 
+	int *iterations)
 {
   int MAXiter, EViter;
   int min;
@@ -45,28 +58,33 @@ int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, blitz::Array<double,1>&
 
   const int N=Psi.size();
   
-  //Matrices
-  blitz::Array<double,1> V0(N);  
-  blitz::Array<double,1> Vorig(N);
-  blitz::Array<double,1> V1(N);  //Ground state vector
-  blitz::Array<double,1> V2(N);
-  blitz::Array<double,1> alpha(LIT);
-  blitz::Array<double,1> beta(LIT);
+  //Matrices: the vectors are views of the first N elements of the
+  //workspace, the rest is used as it is (and grows if needed)
+  LanczosWorkspace& workspace=lanczosWorkspace();
+  workspace.reserve(N, LIT);
+  LIT = workspace.alpha.size();
+  const blitz::Range firstN(0, N-1);
+  blitz::Array<double,1> V0=workspace.V0(firstN);  
+  blitz::Array<double,1> Vorig=workspace.Vorig(firstN);
+  blitz::Array<double,1> V1=workspace.V1(firstN);  //Ground state vector
+  blitz::Array<double,1> V2=workspace.V2(firstN);
+  blitz::Array<double,1>& alpha=workspace.alpha;
+  blitz::Array<double,1>& beta=workspace.beta;
   //For ED of tri-di Matrix routine (C)
   int nn, rtn;
-  blitz::Array<double,1> e(LIT);
-  blitz::Array<double,1> d(LIT); 
-  blitz::Array<double,2> Hmatrix(LIT,LIT);
+  blitz::Array<double,1>& e=workspace.e;
+  blitz::Array<double,1>& d=workspace.d; 
+  blitz::Array<double,2>& Hmatrix=workspace.Hmatrix;
 
-  //tensor indices
-  blitz::firstIndex i;    blitz::secondIndex j;
-  blitz::thirdIndex k;   
+  //the products with the Hamiltonian go through the linear algebra backend
+  LinearAlgebraBackend& backend=linearAlgebra();
   
   int iter = 0;
   //
   // initialize with randon numbers are normalize
   //
   randomize(Vorig);
+  projectOut(Vorig, lowerStates);
   normalize(Vorig);  
 
   for (EViter = 0; EViter < 2; EViter++) {//0=get E0 converge, 1=get eigenvec
@@ -79,7 +97,8 @@ int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, blitz::Array<double,1>&
     V1 = 0;
     beta(0)=0;  //beta_0 not defined
     
-    V1 = sum(Ham(i,j)*V0(j),j); // V1 = H |V0> 
+    backend.gemv(false, 1.0, Ham, V0, 0.0, V1); // V1 = H |V0> 
+    projectOut(V1, lowerStates);
     
     alpha(0) = dotProduct(V0,V1);
     
@@ -88,6 +107,7 @@ int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, blitz::Array<double,1>&
 
     if (fabs(pow(beta(1),2)) < 0.000000001){   //wavefnt Ham alread GS
       *En = alpha(0);
+      if (iterations) *iterations = 0;
       return 1;
     }
 
@@ -103,7 +123,8 @@ int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, blitz::Array<double,1>&
       
       iter++;
       
-      V2 = sum(Ham(i,j)*V1(j),j); // V2 = H |V1>
+      backend.gemv(false, 1.0, Ham, V1, 0.0, V2); // V2 = H |V1>
+      projectOut(V2, lowerStates);
       //V2 -= beta(iter)*V0;
       
       alpha(iter) = dotProduct(V1,V2);
@@ -150,11 +171,7 @@ int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, blitz::Array<double,1>&
         if (iter == LIT-2) {
           LIT += 100;
 	  std::cout<<LIT<<" Resize Lan. it \n";
-          d.resize(LIT);
-          e.resize(LIT);
-          Hmatrix.resize(LIT,LIT);
-          alpha.resizeAndPreserve(LIT);
-          beta.resizeAndPreserve(LIT);
+          workspace.reserve(N, LIT);
         }//end resize
 	
       }//end STARTIT
@@ -165,6 +182,7 @@ int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, blitz::Array<double,1>&
    
     if (EViter == 0){
       MAXiter = iter;
+      if (iterations) *iterations = iter;
       //diagonalize tri-di matrix
       d(0) = alpha(0);
       for (int ii=1;ii<=iter;ii++){
@@ -173,7 +191,8 @@ int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, blitz::Array<double,1>&
       }
       e(iter) = 0;
       //calculate eigenvector
-      Hmatrix = 0;
+      //(up to iter+1: the last vector of the second pass takes row iter+1)
+      Hmatrix(blitz::Range(0,iter+1), blitz::Range(0,iter+1)) = 0;
       for (int ii=0;ii<=iter;ii++)
 	Hmatrix(ii,ii) = 1.0; //identity matrix
       nn = iter+1;
@@ -195,6 +214,58 @@ int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, blitz::Array<double,1>&
 
   return 0;
 } 
+/**
+ * @brief A function to calculate the lowest eigenstates of the
+ * superblock Hamiltonian using the Lanczos algorithm
+ *
+ * @param Hm is a 4-index tensor with the Hamiltonian
+ * @param states a vector with as many matrices as states you want. On
+ * return, states[n] is the n-th lowest eigenstate written as a matrix
+ * @param energies on return, the energies of the states 
+ * @param iterations if not null, on return, the number of Lanczos
+ * iterations done for all the states together
+ *
+ * The states are found one at a time: the Lanczos for the n-th state
+ * is done in the subspace orthogonal to the previous ones.
+ */
+void calculateLowestStates(blitz::Array<double,4>& Hm, 
+	std::vector<blitz::Array<double,2> >& states, 
+	std::vector<double>& energies, int* iterations)
+{
+    blitz::MemoryTagScope memoryTag(LANCZOS_MEMORY);
+
+    const int nn=sqrt(Hm.numElements());
+
+    //complicated integer square root?
+    int L = static_cast<int>(std::sqrt(1.0*nn));          
+
+    // the Hamiltonian as a matrix, in the memory of Hm
+    blitz::Array<double,2> Ham2d=viewAsMatrix(Hm);
+
+    std::vector<blitz::Array<double,1> > lowerStates;
+    energies.resize(states.size());
+    if (iterations) *iterations=0;
+
+    for (size_t n=0; n<states.size(); n++)
+    {
+	blitz::Array<double,1> Psi(nn);  //return eigenvector
+	double En;                //return eigenvalue
+
+	int stateIterations;
+	int lrt = diagonalizeWithLanczos(Ham2d, Psi, &En, lowerStates,
+		&stateIterations); 
+	if (lrt == 1) 
+	  throw dmrg::Exception("Lanczos early term error");
+	if (iterations) *iterations+=stateIterations;
+
+	//Psi as 2D Matrix - Eigenvector: element c2=i1*L+i2 of Psi is
+	//states[n](i2,i1), so states[n] is a transposed view of Psi
+	states[n].reference(hermitianConjugate(viewAsMatrix(Psi, L, L)));
+	energies[n]=En;
+	lowerStates.push_back(Psi);
+    }
+}
+
 /**
  * @brief A function to calculate the ground state function using the
  * Lanczos algorithm
@@ -208,34 +279,41 @@ int diagonalizeWithLanczos(blitz::Array<double,2>& Ham, blitz::Array<double,1>&
 double calculateGroundState(blitz::Array<double,4>& Hm, 
 	blitz::Array<double,2>& Ed)
 {
-    const int nn=sqrt(Hm.numElements());
-
-    blitz::Array<double,2> Ham2d(nn,nn);
-
-    //complicated integer square root?
-    int L = static_cast<int>(std::sqrt(1.0*nn));          
+    std::vector<blitz::Array<double,2> > states(1, Ed);
+    std::vector<double> energies;
 
-    Ham2d=reduceM2M2(Hm);
+    calculateLowestStates(Hm, states, energies);
+    Ed.reference(states[0]);
 
-    blitz::Array<double,1> Psi(nn);  //return eigenvector
-    double En;                //return eigenvalue
+    return energies[0];  //ground state eigenvalue
+}
 
-    int lrt = diagonalizeWithLanczos(Ham2d, Psi, &En); 
-    if (lrt == 1) 
-      throw dmrg::Exception("Lanczos early term error");
+/**
+ * @brief A function to save the state of the random number generator
+ *
+ * @return the state of the generator used for the Lanczos starting
+ * vectors, as text
+ *
+ * Restoring it with setLanczosRandomState() makes the following Lanczos
+ * calls start from the same vectors, e.g. when resuming a run.
+ */
+std::string lanczosRandomState()
+{
+    std::ostringstream state;
+    state<<lanczosRandomGenerator();
+    return state.str();
+}
 
-    //repack Psi as 2D Matrix - Eigenvector
-    int c2 = 0;
-    for (int i1=0; i1<L; i1++)
-    {
-      for (int i2=0; i2<L; i2++)
-      {
-	  double melem = Psi(c2);
-	  //if (melem < 1e-16 && melem > -1e-16) melem = 0;
-	  Ed(i2,i1) = melem;
-	  c2++;
-      }
-    }
-    return En;  //ground state eigenvalue
+/**
+ * @brief A function to restore the state of the random number generator
+ *
+ * @param state a state returned by lanczosRandomState()
+ */
+void setLanczosRandomState(const std::string& state)
+{
+    std::istringstream input(state);
+    input>>lanczosRandomGenerator();
+    if (!input)
+	throw dmrg::Exception("setLanczosRandomState: wrong state");
 }
 //end lanczosDMRG.cpp
@@ -12,8 +12,17 @@
 #ifndef LANCZOS_DMRG_H
 #define LANCZOS_DMRG_H
 
+#include<string>
+#include<vector>
 #include"blitz/array.h"
  
 double calculateGroundState(blitz::Array<double,4>&, blitz::Array<double,2>&);
-int diagonalizeWithLanczos(blitz::Array<double,2>&, blitz::Array<double,1>&, double *);
+void calculateLowestStates(blitz::Array<double,4>&, 
+	std::vector<blitz::Array<double,2> >&, std::vector<double>&,
+	int* iterations=0);
+int diagonalizeWithLanczos(blitz::Array<double,2>&, blitz::Array<double,1>&, 
+	double *, const std::vector<blitz::Array<double,1> >& lowerStates=
+	std::vector<blitz::Array<double,1> >(), int* iterations=0);
+std::string lanczosRandomState();
+void setLanczosRandomState(const std::string&);
 #endif // LANCZOS_DMRG_H
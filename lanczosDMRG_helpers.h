@@ -12,7 +12,9 @@
 #ifndef LANCZOS_DMRG_HELPERS_H
 #define LANCZOS_DMRG_HELPERS_H
  
-#include <cmath>  // for rand()
+#include <cmath>
+#include <random>
+#include <vector>
 #include "blitz/array.h"
 
 /**
@@ -39,6 +41,97 @@ inline double calculateNorm(const blitz::Array<double,1>& V)
   double norm = dotProduct(V,V);           
   return sqrt(norm);
 }
+/**
+ * @brief A function to get the random number generator of the Lanczos
+ *
+ * It is always seeded the same way, so runs are reproducible, and its
+ * state can be saved and restored (see lanczosRandomState()).
+ */
+inline std::mt19937& lanczosRandomGenerator()
+{
+    static std::mt19937 generator;
+    return generator;
+}
+/**
+ * @brief The memory the Lanczos works in
+ *
+ * The Lanczos needs a few vectors of the size of the superblock, and the
+ * coefficients and the tridiagonal matrix of its iterations. They are
+ * kept here from one call to the next: they grow to the largest
+ * superblock and number of iterations seen so far, and then are reused.
+ * Calls on smaller superblocks work on the first elements, so they don't
+ * allocate (or zero) anything.
+ */
+struct LanczosWorkspace
+{
+    /// @name The Lanczos vectors
+    //@{
+    blitz::Array<double,1> V0;
+    blitz::Array<double,1> Vorig;
+    blitz::Array<double,1> V1;
+    blitz::Array<double,1> V2;
+    //@}
+
+    /// @name The iterations
+    //@{
+    blitz::Array<double,1> alpha;
+    blitz::Array<double,1> beta;
+    /// diagonal of the tridiagonal matrix, for tqli2()
+    blitz::Array<double,1> d;
+    /// off-diagonal of the tridiagonal matrix, for tqli2()
+    blitz::Array<double,1> e;
+    /// eigenvectors of the tridiagonal matrix
+    blitz::Array<double,2> Hmatrix;
+    //@}
+
+    /**
+     * @brief Makes room for vectors of n elements and for iterations
+     * Lanczos iterations
+     *
+     * The arrays only grow. The coefficients alpha and beta keep their
+     * values when they grow, as they may grow in the middle of a Lanczos.
+     *
+     * The arrays here are the single owners of their memory, so the
+     * views the Lanczos takes of them don't touch reference counts. The
+     * views must not be kept across a call to reserve().
+     */
+    void reserve(int n, int iterations)
+    {
+	if (n>V0.size())
+	{
+	    V0.resize(n);
+	    Vorig.resize(n);
+	    V1.resize(n);
+	    V2.resize(n);
+	    V0.singleOwner();
+	    Vorig.singleOwner();
+	    V1.singleOwner();
+	    V2.singleOwner();
+	}
+	if (iterations>alpha.size())
+	{
+	    alpha.resizeAndPreserve(iterations);
+	    beta.resizeAndPreserve(iterations);
+	    d.resize(iterations);
+	    e.resize(iterations);
+	    Hmatrix.resize(iterations, iterations);
+	    alpha.singleOwner();
+	    beta.singleOwner();
+	    d.singleOwner();
+	    e.singleOwner();
+	    Hmatrix.singleOwner();
+	}
+    }
+};
+
+/**
+ * @brief A function to get the workspace of the Lanczos
+ */
+inline LanczosWorkspace& lanczosWorkspace()
+{
+    static LanczosWorkspace workspace;
+    return workspace;
+}
 /**
  * @brief A function to randomize a wavefunction
  *
@@ -48,10 +141,11 @@ inline double calculateNorm(const blitz::Array<double,1>& V)
  */
 inline void randomize(blitz::Array<double,1>& V) 
 {
+  std::mt19937& random=lanczosRandomGenerator();
   for (int i=0; i<V.size(); i++)
   {
-      V(i) = rand()%10*0.1;  //random starting vec
-      if ( (rand()%2) == 0) V(i) *= -1.0000001;
+      V(i) = random()%10*0.1;  //random starting vec
+      if ( (random()%2) == 0) V(i) *= -1.0000001;
   }
 }
 
@@ -67,4 +161,20 @@ inline void normalize(blitz::Array<double,1>& V)
   double norm = calculateNorm(V);
   V/=norm;
 }
+
+/**
+ * @brief A function to remove from a wavefunction its projection on a set
+ * of states
+ *
+ * @param V the wavefunction to project
+ * @param states a set of normalized and mutually orthogonal states
+ *
+ * On return V is orthogonal to all the states (but it's not normalized)
+ */
+inline void projectOut(blitz::Array<double,1>& V, 
+	const std::vector<blitz::Array<double,1> >& states)
+{
+    for (size_t s=0; s<states.size(); s++)
+	V-=dotProduct(states[s],V)*states[s];
+}
 #endif // LANCZOS_DMRG_HELPERS_H
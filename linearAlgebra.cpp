@@ -0,0 +1,740 @@
+/**
+ * @file linearAlgebra.cpp
+ *
+ * @brief The reference implementation of the dense linear algebra, and
+ * the binding to BLAS/LAPACK
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "blitz/array.h"
+#include "exceptions.h"
+#include "tred3.h"
+#include "tqli2.h"
+#include "linearAlgebra.h"
+
+/**
+ * @brief Where the elements of a matrix are in memory
+ *
+ * Element (i,j) of the matrix is data[i*ld+j], or data[j*ld+i] if
+ * transposed is true.
+ */
+struct MatrixLayout
+{
+    const double* data;
+    int ld;
+    bool transposed;
+
+    MatrixLayout() : data(0), ld(0), transposed(false) {}
+};
+
+/**
+ * @brief A function to find the layout of a matrix
+ *
+ * @return false if the matrix is neither row-major nor the transpose of
+ * a row-major matrix, e.g. a slice with strides in both dimensions
+ */
+static bool findLayout(const blitz::Array<double,2>& a, MatrixLayout& layout)
+{
+    const int rowStride=a.stride(blitz::firstDim);
+    const int colStride=a.stride(blitz::secondDim);
+    layout.data=a.data();
+    if (colStride==1 && rowStride>=std::max(a.cols(),1))
+    {
+	layout.ld=rowStride;
+	layout.transposed=false;
+	return true;
+    }
+    if (rowStride==1 && colStride>=std::max(a.rows(),1))
+    {
+	layout.ld=colStride;
+	layout.transposed=true;
+	return true;
+    }
+    return false;
+}
+
+/**
+ * @brief A function to get the layout of a matrix, copying it if needed
+ *
+ * @param a the matrix
+ * @param copy where the copy goes, if a has no layout of its own
+ */
+static MatrixLayout layoutOf(const blitz::Array<double,2>& a,
+	blitz::Array<double,2>& copy)
+{
+    MatrixLayout result;
+    if (!findLayout(a, result))
+    {
+	copy.reference(blitz::Array<double,2>(a.rows(), a.cols()));
+	copy=a;
+	findLayout(copy, result);
+    }
+    return result;
+}
+
+/**
+ * @brief The rows and columns of op(a)
+ */
+static void opDims(const blitz::Array<double,2>& a, bool transpose,
+	int& rows, int& cols)
+{
+    rows=transpose? a.cols() : a.rows();
+    cols=transpose? a.rows() : a.cols();
+}
+
+/**
+ * @brief Throws if the matrices don't fit in c = op(a)*op(b)
+ */
+static void checkGemmDims(bool transposeA, bool transposeB,
+	const blitz::Array<double,2>& a, const blitz::Array<double,2>& b,
+	const blitz::Array<double,2>& c)
+{
+    int m, k, kb, n;
+    opDims(a, transposeA, m, k);
+    opDims(b, transposeB, kb, n);
+    if (k!=kb || c.rows()!=m || c.cols()!=n)
+	throw dmrg::Exception("gemm: wrong dims");
+}
+
+/**
+ * @brief Throws if the matrices don't fit in the symmetric eigensystem
+ */
+static void checkEigensystemDims(const blitz::Array<double,2>& a,
+	const blitz::Array<double,1>& eigenvalues)
+{
+    if (a.rows()!=a.cols() || eigenvalues.size()!=a.rows())
+	throw dmrg::Exception("symmetricEigensystem: wrong dims");
+}
+
+/**
+ * @brief Throws if the matrices don't fit in a = u*diag(s)*vt
+ */
+static void checkSvdDims(const blitz::Array<double,2>& a,
+	const blitz::Array<double,2>& u, const blitz::Array<double,1>& s,
+	const blitz::Array<double,2>& vt)
+{
+    const int k=std::min(a.rows(), a.cols());
+    if (u.rows()!=a.rows() || u.cols()!=k || s.size()!=k ||
+	    vt.rows()!=k || vt.cols()!=a.cols())
+	throw dmrg::Exception("svd: wrong dims");
+}
+
+/// tile of rows of a handled together by the syrk kernels
+const int SYRK_ROW_BLOCK=64;
+/// tile of columns of a (summed index) handled together by the kernels
+const int SYRK_SUM_BLOCK=256;
+
+/**
+ * @brief Lower triangle of a*a^T for a matrix with contiguous rows
+ *
+ * @param a pointer to the first element of the matrix
+ * @param n the number of rows of a (and the size of the result)
+ * @param kdim the number of columns of a
+ * @param row_stride distance in memory between two consecutive rows of a
+ * @param weight factor multiplying a*a^T
+ * @param c pointer to a n*n row-major matrix to accumulate into
+ *
+ * The rows are tiled so that two panels of a stay in cache while we
+ * sweep over the sum index, and the innermost loop is a dot product of
+ * two contiguous rows. Tiles of rows of the result are independent, so
+ * they are shared among threads.
+ */
+static void syrkLowerRows(const double* a, int n, int kdim, int row_stride,
+	double weight, double* c)
+{
+#pragma omp parallel for schedule(dynamic)
+    for (int ib=0; ib<n; ib+=SYRK_ROW_BLOCK)
+    {
+	const int iend=std::min(ib+SYRK_ROW_BLOCK, n);
+	for (int jb=0; jb<=ib; jb+=SYRK_ROW_BLOCK)
+	    for (int kb=0; kb<kdim; kb+=SYRK_SUM_BLOCK)
+	    {
+		const int kend=std::min(kb+SYRK_SUM_BLOCK, kdim);
+		for (int i=ib; i<iend; i++)
+		{
+		    const double* ai=a+i*row_stride;
+		    const int jend=(jb==ib)? i+1 : std::min(jb+SYRK_ROW_BLOCK, n);
+		    for (int j=jb; j<jend; j++)
+		    {
+			const double* aj=a+j*row_stride;
+			double s=0.0;
+#pragma omp simd reduction(+:s)
+			for (int k=kb; k<kend; k++)
+			    s+=ai[k]*aj[k];
+			c[i*n+j]+=weight*s;
+		    }
+		}
+	    }
+    }
+}
+
+/**
+ * @brief Lower triangle of a*a^T for a matrix with contiguous columns
+ *
+ * @param a pointer to the first element of the matrix
+ * @param n the number of rows of a (and the size of the result)
+ * @param kdim the number of columns of a
+ * @param col_stride distance in memory between two consecutive columns of a
+ * @param weight factor multiplying a*a^T
+ * @param c pointer to a n*n row-major matrix to accumulate into
+ *
+ * Same tiling as syrkLowerRows, but the result is built as a sum of
+ * rank-one updates so that the innermost loop runs along a column of a.
+ */
+static void syrkLowerColumns(const double* a, int n, int kdim,
+	int col_stride, double weight, double* c)
+{
+#pragma omp parallel for schedule(dynamic)
+    for (int ib=0; ib<n; ib+=SYRK_ROW_BLOCK)
+    {
+	const int iend=std::min(ib+SYRK_ROW_BLOCK, n);
+	for (int jb=0; jb<=ib; jb+=SYRK_ROW_BLOCK)
+	    for (int k=0; k<kdim; k++)
+	    {
+		const double* ak=a+k*col_stride;
+		for (int i=ib; i<iend; i++)
+		{
+		    const double aik=weight*ak[i];
+		    double* ci=c+i*n;
+		    const int jend=(jb==ib)? i+1 : std::min(jb+SYRK_ROW_BLOCK, n);
+#pragma omp simd
+		    for (int j=jb; j<jend; j++)
+			ci[j]+=aik*ak[j];
+		}
+	    }
+    }
+}
+
+/**
+ * @brief The dense linear algebra written in this code
+ *
+ * The products run over contiguous rows, so the inner loops vectorize,
+ * and the rows of the results are shared among threads. The symmetric
+ * eigensystem is the Householder reduction of tred3() followed by
+ * tqli2(), and the singular value decomposition is a one-sided Jacobi.
+ */
+class ReferenceLinearAlgebra : public LinearAlgebraBackend {
+    public:
+	std::string name() const { return "reference"; }
+	bool tuned() const { return false; }
+
+	/**
+	 * The rows of c are built as sums of rows of op(b), each times an
+	 * element of op(a). If the rows of op(b) are not contiguous, op(b)
+	 * is copied first.
+	 */
+	void gemm(bool transposeA, bool transposeB, double alpha,
+		const blitz::Array<double,2>& a,
+		const blitz::Array<double,2>& b,
+		double beta, blitz::Array<double,2>& c)
+	{
+	    checkGemmDims(transposeA, transposeB, a, b, c);
+	    int m, k, n;
+	    opDims(a, transposeA, m, k);
+	    n=c.cols();
+
+	    blitz::Array<double,2> aCopy, bCopy, cCopy;
+	    MatrixLayout la=layoutOf(a, aCopy);
+	    MatrixLayout lb=layoutOf(b, bCopy);
+	    const bool ta=(transposeA!=la.transposed);
+	    if (transposeB!=lb.transposed)
+	    {
+		// rows of op(b) in memory
+		bCopy.reference(blitz::Array<double,2>(k, n));
+		if (transposeB)
+		    bCopy=b.transpose(blitz::secondDim, blitz::firstDim);
+		else
+		    bCopy=b;
+		findLayout(bCopy, lb);
+	    }
+
+	    MatrixLayout lc;
+	    const bool cInPlace=findLayout(c, lc) && !lc.transposed;
+	    if (!cInPlace)
+	    {
+		cCopy.reference(blitz::Array<double,2>(m, n));
+		cCopy=c;
+		findLayout(cCopy, lc);
+	    }
+	    double* cData=const_cast<double*>(lc.data);
+
+#pragma omp parallel for schedule(static)
+	    for (int i=0; i<m; i++)
+	    {
+		double* ci=cData+size_t(i)*lc.ld;
+		if (beta==0.0)
+		    std::fill(ci, ci+n, 0.0);
+		else if (beta!=1.0)
+		    for (int j=0; j<n; j++)
+			ci[j]*=beta;
+		for (int p=0; p<k; p++)
+		{
+		    const double aip=alpha*(ta? la.data[size_t(p)*la.ld+i] :
+			    la.data[size_t(i)*la.ld+p]);
+		    const double* bp=lb.data+size_t(p)*lb.ld;
+#pragma omp simd
+		    for (int j=0; j<n; j++)
+			ci[j]+=aip*bp[j];
+		}
+	    }
+
+	    if (!cInPlace)
+		c=cCopy;
+	}
+
+	/**
+	 * If the rows of op(a) are contiguous every element of y is a dot
+	 * product, otherwise y is a sum of columns of op(a).
+	 */
+	void gemv(bool transposeA, double alpha,
+		const blitz::Array<double,2>& a,
+		const blitz::Array<double,1>& x,
+		double beta, blitz::Array<double,1>& y)
+	{
+	    int m, n;
+	    opDims(a, transposeA, m, n);
+	    if (x.size()!=n || y.size()!=m)
+		throw dmrg::Exception("gemv: wrong dims");
+
+	    blitz::Array<double,2> aCopy;
+	    MatrixLayout la=layoutOf(a, aCopy);
+	    const bool ta=(transposeA!=la.transposed);
+	    const double* xData=x.data();
+	    const int incx=x.stride(blitz::firstDim);
+	    double* yData=y.data();
+	    const int incy=y.stride(blitz::firstDim);
+
+	    if (!ta)
+	    {
+#pragma omp parallel for schedule(static)
+		for (int i=0; i<m; i++)
+		{
+		    const double* ai=la.data+size_t(i)*la.ld;
+		    double s=0.0;
+#pragma omp simd reduction(+:s)
+		    for (int j=0; j<n; j++)
+			s+=ai[j]*xData[j*incx];
+		    double& yi=yData[i*incy];
+		    yi=(beta==0.0? 0.0 : beta*yi)+alpha*s;
+		}
+	    }
+	    else
+	    {
+		for (int i=0; i<m; i++)
+		{
+		    double& yi=yData[i*incy];
+		    yi=(beta==0.0? 0.0 : beta*yi);
+		}
+		for (int j=0; j<n; j++)
+		{
+		    const double* aj=la.data+size_t(j)*la.ld;
+		    const double xj=alpha*xData[j*incx];
+		    for (int i=0; i<m; i++)
+			yData[i*incy]+=xj*aj[i];
+		}
+	    }
+	}
+
+	/**
+	 * Picks the kernel that matches the storage of a.
+	 */
+	void syrk(double alpha, const blitz::Array<double,2>& a,
+		blitz::Array<double,2>& c)
+	{
+	    const int n=a.rows();
+	    if (c.rows()!=n || c.cols()!=n)
+		throw dmrg::Exception("syrk: wrong dims");
+	    MatrixLayout lc;
+	    if (!findLayout(c, lc) || lc.transposed || lc.ld!=n)
+		throw dmrg::Exception("syrk: c is not row-major");
+	    double* cData=c.data();
+
+	    blitz::Array<double,2> aCopy;
+	    MatrixLayout la=layoutOf(a, aCopy);
+	    if (!la.transposed)
+		syrkLowerRows(la.data, n, a.cols(), la.ld, alpha, cData);
+	    else
+		syrkLowerColumns(la.data, n, a.cols(), la.ld, alpha, cData);
+	}
+
+	/**
+	 * Reduces the matrix to a tridiagonal form using the Householder
+	 * reduction, and then diagonalizes the tridiagonal matrix.
+	 */
+	void symmetricEigensystem(blitz::Array<double,2>& a,
+		blitz::Array<double,1>& eigenvalues)
+	{
+	    checkEigensystemDims(a, eigenvalues);
+	    const int n=a.rows();
+	    // temporary array
+	    blitz::Array<double,1> e(n);
+
+	    // reduce symmetric matrix to a tridiagonal form
+	    tred3(a, eigenvalues, e, n);
+
+	    // diagonalizes a tridiagonal matrix
+	    tqli2(eigenvalues, e, n, a, 1);
+	}
+
+	/**
+	 * One-sided Jacobi: pairs of columns of a are rotated until they are
+	 * all orthogonal, then their norms are the singular values. The
+	 * columns are kept as rows of a transposed copy, so the rotations
+	 * run over contiguous memory. If a has more columns than rows, its
+	 * transpose is decomposed instead. The singular vectors of the zero
+	 * singular values are left as zero.
+	 */
+	void svd(const blitz::Array<double,2>& a,
+		blitz::Array<double,2>& u, blitz::Array<double,1>& s,
+		blitz::Array<double,2>& vt)
+	{
+	    checkSvdDims(a, u, s, vt);
+	    const bool wide=a.cols()>a.rows();
+	    // w is tall: rows x k, and its columns are stored as rows
+	    const blitz::Array<double,2> w= wide?
+		a.transpose(blitz::secondDim, blitz::firstDim) : a;
+	    const int rows=w.rows();
+	    const int k=w.cols();
+
+	    blitz::Array<double,2> columns(k, rows);
+	    columns=w.transpose(blitz::secondDim, blitz::firstDim);
+	    blitz::Array<double,2> v(k, k);
+	    v=0.0;
+	    for (int p=0; p<k; p++)
+		v(p,p)=1.0;
+
+	    const double eps=1e-15;
+	    for (int sweep=0; sweep<60; sweep++)
+	    {
+		bool rotated=false;
+		for (int p=0; p<k-1; p++)
+		    for (int q=p+1; q<k; q++)
+		    {
+			double* cp=&columns(p,0);
+			double* cq=&columns(q,0);
+			double app=0.0, aqq=0.0, apq=0.0;
+			for (int i=0; i<rows; i++)
+			{
+			    app+=cp[i]*cp[i];
+			    aqq+=cq[i]*cq[i];
+			    apq+=cp[i]*cq[i];
+			}
+			if (fabs(apq)<=eps*sqrt(app*aqq))
+			    continue;
+			rotated=true;
+
+			const double zeta=(aqq-app)/(2.0*apq);
+			const double t=(zeta>=0.0? 1.0 : -1.0)/
+			    (fabs(zeta)+sqrt(1.0+zeta*zeta));
+			const double cs=1.0/sqrt(1.0+t*t);
+			const double sn=cs*t;
+			for (int i=0; i<rows; i++)
+			{
+			    const double x=cp[i], y=cq[i];
+			    cp[i]=cs*x-sn*y;
+			    cq[i]=sn*x+cs*y;
+			}
+			double* vp=&v(p,0);
+			double* vq=&v(q,0);
+			for (int i=0; i<k; i++)
+			{
+			    const double x=vp[i], y=vq[i];
+			    vp[i]=cs*x-sn*y;
+			    vq[i]=sn*x+cs*y;
+			}
+		    }
+		if (!rotated)
+		    break;
+	    }
+
+	    // order the singular values
+	    std::vector<std::pair<double,int> > norms(k);
+	    for (int p=0; p<k; p++)
+	    {
+		double norm=0.0;
+		for (int i=0; i<rows; i++)
+		    norm+=columns(p,i)*columns(p,i);
+		norms[p]=std::make_pair(-sqrt(norm), p);
+	    }
+	    std::sort(norms.begin(), norms.end());
+
+	    // w = left*diag(s)*right, with right(n,:) the row p of v
+	    blitz::Array<double,2> left= wide?
+		vt.transpose(blitz::secondDim, blitz::firstDim) : u;
+	    blitz::Array<double,2> right= wide?
+		u.transpose(blitz::secondDim, blitz::firstDim) : vt;
+	    for (int n=0; n<k; n++)
+	    {
+		const double sigma=-norms[n].first;
+		const int p=norms[n].second;
+		s(n)=sigma;
+		for (int i=0; i<rows; i++)
+		    left(i,n)= sigma>0.0? columns(p,i)/sigma : 0.0;
+		for (int i=0; i<k; i++)
+		    right(n,i)=v(p,i);
+	    }
+	}
+};
+
+#ifdef DMRG_LAPACK
+extern "C" {
+    void dgemm_(const char* transa, const char* transb, const int* m,
+	    const int* n, const int* k, const double* alpha, const double* a,
+	    const int* lda, const double* b, const int* ldb,
+	    const double* beta, double* c, const int* ldc);
+    void dgemv_(const char* trans, const int* m, const int* n,
+	    const double* alpha, const double* a, const int* lda,
+	    const double* x, const int* incx, const double* beta, double* y,
+	    const int* incy);
+    void dsyrk_(const char* uplo, const char* trans, const int* n,
+	    const int* k, const double* alpha, const double* a,
+	    const int* lda, const double* beta, double* c, const int* ldc);
+    void dsyevd_(const char* jobz, const char* uplo, const int* n,
+	    double* a, const int* lda, double* w, double* work,
+	    const int* lwork, int* iwork, const int* liwork, int* info);
+    void dgesdd_(const char* jobz, const int* m, const int* n, double* a,
+	    const int* lda, double* s, double* u, const int* ldu, double* vt,
+	    const int* ldvt, double* work, const int* lwork, int* iwork,
+	    int* info);
+}
+
+/**
+ * @brief The dense linear algebra of a BLAS/LAPACK library
+ *
+ * The libraries take column-major matrices, and a row-major matrix is
+ * the transpose of a column-major one, so every call is written for the
+ * transposes: c = a*b is done as c^T = b^T*a^T.
+ */
+class LapackLinearAlgebra : public LinearAlgebraBackend {
+    public:
+	std::string name() const { return "lapack"; }
+	bool tuned() const { return true; }
+
+	void gemm(bool transposeA, bool transposeB, double alpha,
+		const blitz::Array<double,2>& a,
+		const blitz::Array<double,2>& b,
+		double beta, blitz::Array<double,2>& c)
+	{
+	    checkGemmDims(transposeA, transposeB, a, b, c);
+	    int m, k, n;
+	    opDims(a, transposeA, m, k);
+	    n=c.cols();
+	    if (m==0 || n==0)
+		return;
+
+	    blitz::Array<double,2> aCopy, bCopy, cCopy;
+	    MatrixLayout la=layoutOf(a, aCopy);
+	    MatrixLayout lb=layoutOf(b, bCopy);
+	    MatrixLayout lc;
+	    const bool cInPlace=findLayout(c, lc) && !lc.transposed;
+	    if (!cInPlace)
+	    {
+		cCopy.reference(blitz::Array<double,2>(m, n));
+		cCopy=c;
+		findLayout(cCopy, lc);
+	    }
+
+	    const char ta=(transposeA!=la.transposed)? 'T' : 'N';
+	    const char tb=(transposeB!=lb.transposed)? 'T' : 'N';
+	    dgemm_(&tb, &ta, &n, &m, &k, &alpha, lb.data, &lb.ld,
+		    la.data, &la.ld, &beta, const_cast<double*>(lc.data),
+		    &lc.ld);
+
+	    if (!cInPlace)
+		c=cCopy;
+	}
+
+	void gemv(bool transposeA, double alpha,
+		const blitz::Array<double,2>& a,
+		const blitz::Array<double,1>& x,
+		double beta, blitz::Array<double,1>& y)
+	{
+	    int m, n;
+	    opDims(a, transposeA, m, n);
+	    if (x.size()!=n || y.size()!=m)
+		throw dmrg::Exception("gemv: wrong dims");
+	    if (m==0)
+		return;
+
+	    blitz::Array<double,2> aCopy;
+	    MatrixLayout la=layoutOf(a, aCopy);
+	    // the memory of a, column-major, is cols x rows
+	    const int rows=la.transposed? a.rows() : a.cols();
+	    const int cols=la.transposed? a.cols() : a.rows();
+	    const char ta=(transposeA!=la.transposed)? 'N' : 'T';
+	    const int incx=x.stride(blitz::firstDim);
+	    const int incy=y.stride(blitz::firstDim);
+	    dgemv_(&ta, &rows, &cols, &alpha, la.data, &la.ld, x.data(),
+		    &incx, &beta, y.data(), &incy);
+	}
+
+	void syrk(double alpha, const blitz::Array<double,2>& a,
+		blitz::Array<double,2>& c)
+	{
+	    const int n=a.rows();
+	    const int k=a.cols();
+	    if (c.rows()!=n || c.cols()!=n)
+		throw dmrg::Exception("syrk: wrong dims");
+	    MatrixLayout lc;
+	    if (!findLayout(c, lc) || lc.transposed || lc.ld!=n)
+		throw dmrg::Exception("syrk: c is not row-major");
+	    if (n==0)
+		return;
+
+	    // the lower triangle of c is the upper one for the library
+	    blitz::Array<double,2> aCopy;
+	    MatrixLayout la=layoutOf(a, aCopy);
+	    const char uplo='U';
+	    const char ta=la.transposed? 'N' : 'T';
+	    const double beta=1.0;
+	    dsyrk_(&uplo, &ta, &n, &k, &alpha, la.data, &la.ld, &beta,
+		    c.data(), &n);
+	}
+
+	/**
+	 * The library leaves eigenvector i in row i of the row-major
+	 * matrix, so it is transposed at the end.
+	 */
+	void symmetricEigensystem(blitz::Array<double,2>& a,
+		blitz::Array<double,1>& eigenvalues)
+	{
+	    checkEigensystemDims(a, eigenvalues);
+	    const int n=a.rows();
+	    if (n==0)
+		return;
+
+	    blitz::Array<double,2> work2d(n,n);
+	    work2d=a;
+	    blitz::Array<double,1> w(n);
+
+	    const char jobz='V', uplo='U';
+	    int info=0;
+	    int lwork=-1, liwork=-1, iworkSize=0;
+	    double workSize=0.0;
+	    dsyevd_(&jobz, &uplo, &n, work2d.data(), &n, w.data(), &workSize,
+		    &lwork, &iworkSize, &liwork, &info);
+	    lwork=int(workSize);
+	    liwork=iworkSize;
+	    std::vector<double> work(std::max(lwork,1));
+	    std::vector<int> iwork(std::max(liwork,1));
+	    dsyevd_(&jobz, &uplo, &n, work2d.data(), &n, w.data(), &work[0],
+		    &lwork, &iwork[0], &liwork, &info);
+	    if (info!=0)
+		throw dmrg::Exception("symmetricEigensystem: dsyevd failed");
+
+	    a=work2d.transpose(blitz::secondDim, blitz::firstDim);
+	    eigenvalues=w;
+	}
+
+	/**
+	 * The library decomposes a^T = vt^T*diag(s)*u^T, so its u is our
+	 * vt and the other way around, both row-major.
+	 */
+	void svd(const blitz::Array<double,2>& a,
+		blitz::Array<double,2>& u, blitz::Array<double,1>& s,
+		blitz::Array<double,2>& vt)
+	{
+	    checkSvdDims(a, u, s, vt);
+	    const int rows=a.rows();
+	    const int cols=a.cols();
+	    const int k=std::min(rows, cols);
+	    if (k==0)
+		return;
+
+	    blitz::Array<double,2> copy(rows, cols);
+	    copy=a;
+	    blitz::Array<double,2> left(rows, k), right(k, cols);
+	    blitz::Array<double,1> sigma(k);
+
+	    const char jobz='S';
+	    int info=0, lwork=-1;
+	    double workSize=0.0;
+	    std::vector<int> iwork(8*k);
+	    dgesdd_(&jobz, &cols, &rows, copy.data(), &cols, sigma.data(),
+		    right.data(), &cols, left.data(), &k, &workSize, &lwork,
+		    &iwork[0], &info);
+	    lwork=int(workSize);
+	    std::vector<double> work(std::max(lwork,1));
+	    dgesdd_(&jobz, &cols, &rows, copy.data(), &cols, sigma.data(),
+		    right.data(), &cols, left.data(), &k, &work[0], &lwork,
+		    &iwork[0], &info);
+	    if (info!=0)
+		throw dmrg::Exception("svd: dgesdd failed");
+
+	    u=left;
+	    s=sigma;
+	    vt=right;
+	}
+};
+#endif // DMRG_LAPACK
+
+/**
+ * @brief A function to get the reference implementation
+ */
+LinearAlgebraBackend& referenceLinearAlgebra()
+{
+    static ReferenceLinearAlgebra backend;
+    return backend;
+}
+
+/**
+ * @brief A function to find a backend by name
+ *
+ * @param name "reference", or "lapack" for the BLAS/LAPACK library
+ * @return the backend, or null if there is none of that name in this
+ * build
+ */
+LinearAlgebraBackend* findLinearAlgebraBackend(const std::string& name)
+{
+    if (name=="reference")
+	return &referenceLinearAlgebra();
+#ifdef DMRG_LAPACK
+    static LapackLinearAlgebra lapack;
+    if (name=="lapack")
+	return &lapack;
+#endif
+    return 0;
+}
+
+/**
+ * @brief The backend in use
+ *
+ * It is the BLAS/LAPACK library if the code is built with it, and the
+ * reference implementation otherwise.
+ */
+static LinearAlgebraBackend*& currentBackend()
+{
+#ifdef DMRG_LAPACK
+    static LinearAlgebraBackend* backend=findLinearAlgebraBackend("lapack");
+#else
+    static LinearAlgebraBackend* backend=&referenceLinearAlgebra();
+#endif
+    return backend;
+}
+
+/**
+ * @brief A function to get the backend of the dense linear algebra
+ */
+LinearAlgebraBackend& linearAlgebra()
+{
+    return *currentBackend();
+}
+
+/**
+ * @brief A function to choose the backend of the dense linear algebra
+ *
+ * @param backend the backend; it must live until the last call to
+ * linearAlgebra() (those returned by findLinearAlgebraBackend() do)
+ */
+void setLinearAlgebraBackend(LinearAlgebraBackend& backend)
+{
+    currentBackend()=&backend;
+}
+// end linearAlgebra.cpp
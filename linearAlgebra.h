@@ -0,0 +1,88 @@
+/**
+ * @file linearAlgebra.h
+ *
+ * @brief The dense linear algebra used by the DMRG: matrix products,
+ * symmetric eigensystems and singular value decompositions
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#ifndef LINEAR_ALGEBRA_H
+#define LINEAR_ALGEBRA_H
+
+#include <string>
+#include "blitz/array.h"
+
+/**
+ * @brief The kernels of dense linear algebra the DMRG is built on
+ *
+ * The matrices are Blitz++ arrays of any storage: row-major ones, their
+ * transposes (like hermitianConjugate() returns) and the views of
+ * viewAsMatrix() are used as they are, and anything else is copied
+ * first. The results are written in their arrays, which must have the
+ * right size already.
+ *
+ * There are two implementations: the reference one, written here with
+ * the rest of the code and always available, and one that calls a
+ * BLAS/LAPACK library such as OpenBLAS, built with <tt>make
+ * lapack=1</tt>. The one in use is returned by linearAlgebra(); the
+ * callers don't know which one it is.
+ */
+class LinearAlgebraBackend {
+    public:
+	virtual ~LinearAlgebraBackend() {}
+
+	/// a name for the backend, as taken by findLinearAlgebraBackend()
+	virtual std::string name() const=0;
+
+	/**
+	 * @brief true if the kernels come from a tuned library
+	 *
+	 * Some callers have fused kernels of their own that are faster
+	 * than a few calls to the reference kernels, but not than a tuned
+	 * library. They use the backend only when this is true.
+	 */
+	virtual bool tuned() const=0;
+
+	/// c = alpha*op(a)*op(b) + beta*c, op(x) is x or its transpose
+	virtual void gemm(bool transposeA, bool transposeB, double alpha,
+		const blitz::Array<double,2>& a,
+		const blitz::Array<double,2>& b,
+		double beta, blitz::Array<double,2>& c)=0;
+
+	/// y = alpha*op(a)*x + beta*y, op(a) is a or its transpose
+	virtual void gemv(bool transposeA, double alpha,
+		const blitz::Array<double,2>& a,
+		const blitz::Array<double,1>& x,
+		double beta, blitz::Array<double,1>& y)=0;
+
+	/// adds alpha*a*a^T to the lower triangle of the square matrix c,
+	/// which must be row-major. The upper triangle is not touched
+	virtual void syrk(double alpha, const blitz::Array<double,2>& a,
+		blitz::Array<double,2>& c)=0;
+
+	/// on return a(j,i) is the element j of the eigenvector of the
+	/// symmetric matrix a with eigenvalue eigenvalues(i). The
+	/// eigenvalues are in no particular order
+	virtual void symmetricEigensystem(blitz::Array<double,2>& a,
+		blitz::Array<double,1>& eigenvalues)=0;
+
+	/// a = u*diag(s)*vt, with the k=min(rows,cols) singular values s in
+	/// decreasing order, u rows x k and vt k x cols
+	virtual void svd(const blitz::Array<double,2>& a,
+		blitz::Array<double,2>& u, blitz::Array<double,1>& s,
+		blitz::Array<double,2>& vt)=0;
+};
+
+LinearAlgebraBackend& linearAlgebra();
+
+void setLinearAlgebraBackend(LinearAlgebraBackend& backend);
+
+LinearAlgebraBackend* findLinearAlgebraBackend(const std::string& name);
+
+LinearAlgebraBackend& referenceLinearAlgebra();
+
+#endif // LINEAR_ALGEBRA_H
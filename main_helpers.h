@@ -12,6 +12,142 @@
 #define MAIN_HELPERS_H  
 
 #include<iostream>
+#include<iomanip>
+#include<cmath>
+#include<cstdlib>
+#include<string>
+#include<vector>
+#include<sys/time.h>
+#include "exceptions.h"
+
+/**
+ * @brief Optional parameters of a run
+ *
+ * The three basic parameters (states to keep, sites, sweeps) are read
+ * from the standard input as always. Anything else is optional and can
+ * be given in the command line as key=value pairs, e.g.
+ *
+ * \code $ ./a.out noise=1e-4 noiseDecay=0.5 \endcode
+ */
+struct RunOptions
+{
+    /// number of lowest eigenstates targeted by the density matrix
+    int targets;
+    /// amplitude of the density matrix perturbation in the first half sweep
+    double noise;
+    /// factor multiplying the perturbation amplitude after each half sweep
+    double noiseDecay;
+    /// megabytes of blocks kept in memory before spilling them to disk
+    double blockMemory;
+    /// directory where the blocks are spilled
+    std::string scratch;
+    /// map the spilled blocks in memory instead of reading them
+    bool mapBlocks;
+    /// maximum number of spilled blocks waiting to be written
+    int writeQueue;
+    /// compress the spilled blocks
+    bool compress;
+    /// elements of the spilled blocks smaller than this are dropped
+    double compressThreshold;
+    /// steps of the finite system algorithm between checkpoints, 0 for no
+    /// checkpoints
+    int checkpoint;
+    /// resume the run from the checkpoint in the scratch directory
+    bool restart;
+    /// file where the ground state is saved at the end of the run as a
+    /// matrix product state, empty for none
+    std::string mps;
+    /// file where the results of each step are streamed, empty for none
+    std::string results;
+    /// format of the results file: "json" (JSON lines) or "binary"
+    std::string resultsFormat;
+    /// reuse the memory of the arrays from one step to the next
+    bool arrayPool;
+    /// back the large arrays with huge pages
+    bool hugePages;
+    /// only print the estimated memory of the run
+    bool estimateMemory;
+    /// backend of the dense linear algebra: "reference" or "lapack", empty
+    /// for the default of the build
+    std::string linearAlgebra;
+
+    RunOptions() : targets(1), noise(0.0), noiseDecay(0.5), 
+	blockMemory(1024.0), scratch("."), mapBlocks(true), writeQueue(4),
+	compress(false), compressThreshold(0.0), checkpoint(0), 
+	restart(false), resultsFormat("json"), arrayPool(true),
+	hugePages(true), estimateMemory(false) {}
+};
+
+/**
+ * @brief A function to read the optional parameters from the command line
+ *
+ * @param argc number of arguments, as passed to main()
+ * @param argv the arguments, as passed to main()
+ *
+ * Throws a dmrg::Exception if an argument is not of the form key=value or
+ * the key is unknown.
+ */
+inline RunOptions parseRunOptions(int argc, char* argv[])
+{
+    RunOptions result;
+    for (int a=1; a<argc; a++)
+    {
+	std::string arg(argv[a]);
+	std::string::size_type eq=arg.find('=');
+	if (eq==std::string::npos)
+	    throw dmrg::Exception("parseRunOptions: expected key=value: "+arg);
+	std::string key=arg.substr(0,eq);
+	const char* value=argv[a]+eq+1;
+
+	if (key=="targets") result.targets=atoi(value);
+	else if (key=="noise") result.noise=atof(value);
+	else if (key=="noiseDecay") result.noiseDecay=atof(value);
+	else if (key=="blockMemory") result.blockMemory=atof(value);
+	else if (key=="scratch") result.scratch=value;
+	else if (key=="mapBlocks") result.mapBlocks=atoi(value)!=0;
+	else if (key=="writeQueue") result.writeQueue=atoi(value);
+	else if (key=="compress") result.compress=atoi(value)!=0;
+	else if (key=="compressThreshold") result.compressThreshold=atof(value);
+	else if (key=="checkpoint") result.checkpoint=atoi(value);
+	else if (key=="restart") result.restart=atoi(value)!=0;
+	else if (key=="mps") result.mps=value;
+	else if (key=="results") result.results=value;
+	else if (key=="resultsFormat") result.resultsFormat=value;
+	else if (key=="arrayPool") result.arrayPool=atoi(value)!=0;
+	else if (key=="hugePages") result.hugePages=atoi(value)!=0;
+	else if (key=="estimateMemory") result.estimateMemory=atoi(value)!=0;
+	else if (key=="linearAlgebra") result.linearAlgebra=value;
+	else throw dmrg::Exception("parseRunOptions: unknown option "+key);
+    }
+    if (result.targets<1)
+	throw dmrg::Exception("parseRunOptions: targets must be positive");
+    if (result.blockMemory<0.0)
+	throw dmrg::Exception("parseRunOptions: blockMemory is negative");
+    if (result.writeQueue<0)
+	throw dmrg::Exception("parseRunOptions: writeQueue is negative");
+    if (result.compressThreshold<0.0)
+	throw dmrg::Exception("parseRunOptions: compressThreshold is negative");
+    if (result.checkpoint<0)
+	throw dmrg::Exception("parseRunOptions: checkpoint is negative");
+    if (result.resultsFormat!="json" && result.resultsFormat!="binary")
+	throw dmrg::Exception("parseRunOptions: resultsFormat must be json "
+		"or binary");
+    if (!result.linearAlgebra.empty() && result.linearAlgebra!="reference" 
+	    && result.linearAlgebra!="lapack")
+	throw dmrg::Exception("parseRunOptions: linearAlgebra must be "
+		"reference or lapack");
+    return result;
+}
+
+/**
+ * @brief A function to get the wall clock time in seconds
+ */
+inline double wallTime()
+{
+    timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec+1e-6*tv.tv_usec;
+}
 
 /**
  * @brief A function to calculate the minimum size of the enviroment
@@ -44,4 +180,22 @@ inline void printGroundStateEnergy(int sitesInLeft, int sitesInRight,
     std::cout<<sitesInLeft<<" "<<sitesInRight\
 	<<" "<<groundStateEnergy/(sitesInLeft+sitesInRight)<<std::endl;
 }
+
+/**
+ * @brief A function to print the energies of all the target states
+ *
+ * Prints the sites in the left block, sites in the right block and
+ * energy per site of the ground state, like printGroundStateEnergy(),
+ * followed by the gaps to the excited states, if any.
+ */
+inline void printTargetEnergies(int sitesInLeft, int sitesInRight, 
+	const std::vector<double>& energies)
+{
+    std::cout<<std::setprecision(16);
+    std::cout<<sitesInLeft<<" "<<sitesInRight\
+	<<" "<<energies[0]/(sitesInLeft+sitesInRight);
+    for (size_t n=1; n<energies.size(); n++)
+	std::cout<<" "<<energies[n]-energies[0];
+    std::cout<<std::endl;
+}
 #endif //MAIN_HELPERS_H
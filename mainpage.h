@@ -66,12 +66,32 @@
  * If you do not have make installed, run this command instead:
  *
  * \code
- * $ g++ -c -O3 -I. tqli2.cpp tred3.cpp heisenberg.cpp densityMatrix.cpp lanczosDMRG.cpp
+ * $ g++ -c -O3 -I. tqli2.cpp tred3.cpp heisenberg.cpp densityMatrix.cpp lanczosDMRG.cpp blockFile.cpp
+ * blockCodec.cpp blockArchive.cpp blockStore.cpp checkpoint.cpp mps.cpp
+ * results.cpp arrayPool.cpp memoryUsage.cpp linearAlgebra.cpp
  * \endcode
  *
  * This will make a executable file called a.out that
  * implements the DMRG algorithm for the one-dimensional Heisenberg model.
  *
+ * The matrix products and diagonalizations are done by the code itself.
+ * If you have a BLAS/LAPACK library such as OpenBLAS, you can use it
+ * instead with
+ *
+ * \code $ make lapack=1 \endcode
+ *
+ * which links with -lopenblas. For another library set LAPACK_LIBS, e.g.
+ * <tt>make lapack=1 LAPACK_LIBS="-llapack -lblas"</tt>.
+ *
+ * To check the build, run
+ *
+ * \code $ make check \endcode
+ *
+ * It checks the compression of the blocks on fixed data (see tests/codec)
+ * and the kernels of the linear algebra backends of the build against
+ * plain loops (see tests/linearAlgebra), then does two short runs and checks that the ground state they save as
+ * a matrix product state has the energy of the run (see tests/mps).
+ *
  * \section run Running the code
  *
  * To run the code do: 
@@ -96,6 +116,83 @@
  * number of FSA sweeps: 5 
  * \endcode
  *
+ * \subsection options Optional parameters
+ *
+ * A few more parameters can be given in the command line as key=value
+ * pairs (see parseRunOptions()):
+ *
+ * <ul>
+ * <li> targets: number of lowest states kept in the density matrix with
+ * equal weights (default 1, the ground state only). When it's larger than
+ * one, each line of the output ends with the gaps between the excited
+ * states and the ground state
+ * <li> noise: amplitude of White's perturbation of the reduced density
+ * matrix in the first half sweep (default 0, i.e. no perturbation)
+ * <li> noiseDecay: factor multiplying the amplitude after each half sweep
+ * (default 0.5)
+ * <li> blockMemory: megabytes of blocks kept in memory (default 1024).
+ * When there are more blocks, the least recently used ones are written
+ * to disk
+ * <li> scratch: directory where the blocks are written (default the
+ * current directory). They all go to a single file, blocks.dmrg, that
+ * is removed at the end of the run
+ * <li> mapBlocks: if 1 (the default) the blocks written to disk are
+ * mapped in memory when they are needed again, instead of read. Set it to
+ * 0 to read them
+ * <li> writeQueue: how many blocks can wait to be written to disk by a
+ * background thread while the calculation goes on (default 4). Set it to
+ * 0 to write them right away
+ * <li> compress: if 1 the blocks written to disk are compressed (default
+ * 0). Compressed blocks take less disk space but are always read, never
+ * mapped
+ * <li> compressThreshold: elements of the compressed blocks smaller than
+ * this, in absolute value, are stored as zeros (default 0, i.e. lossless
+ * compression)
+ * <li> checkpoint: number of steps of the finite system algorithm between
+ * checkpoints (default 0, i.e. no checkpoints). A checkpoint saves
+ * everything needed to resume the run in the file checkpoint.dmrg of the
+ * scratch directory, and keeps the blocks in blocks.dmrg. To move a run
+ * to another scratch directory, copy both files there
+ * <li> restart: if 1, the run is resumed from the checkpoint in the
+ * scratch directory, skipping the infinite system algorithm. The number
+ * of states and of sites must be the same as in the run that saved it;
+ * the number of half sweeps can be larger, and must be larger than the
+ * half sweep the checkpoint was saved in. The results of the resumed
+ * steps are added at the end of the results file, if any, after a
+ * record that marks the restart
+ * <li> mps: a file where the ground state is saved at the end of the run,
+ * as a matrix product state (default none). It is built from the
+ * truncation matrices of the blocks, so observables and overlaps can be
+ * calculated later without running the DMRG again (see
+ * readMatrixProductState())
+ * <li> results: a file where the results of each step are saved as they
+ * come (default none): the blocks, the energy, the truncation error, the
+ * number of states kept and of Lanczos iterations, the time spent in
+ * the step, and the memory of the arrays at the end of the step and at
+ * its peak, by what they are for (see MemoryTag)
+ * <li> resultsFormat: json (the default), for one JSON object per line,
+ * or binary, for the compact format described in results.cpp
+ * <li> arrayPool: if 1 (the default) the memory of the arrays freed in a
+ * step is kept and reused in the next steps (see ArrayPool) instead of
+ * being allocated again. Set it to 0 to allocate every array anew. Either
+ * way the arrays are aligned for the vector instructions, and the large
+ * ones are spread over the NUMA nodes (see AlignedAllocator)
+ * <li> hugePages: if 1 (the default) the arrays of 2 MB or more are backed
+ * by huge pages when the system allows it. Set it to 0 to use normal
+ * pages
+ * <li> estimateMemory: if 1, the program only prints how much memory the
+ * arrays of the run would take at most (see estimateMemoryUsage()), and
+ * exits without running it. Use it to choose m before a long run
+ * <li> linearAlgebra: reference, for the matrix products and
+ * diagonalizations written in the code, or lapack, for the BLAS/LAPACK
+ * library (see LinearAlgebraBackend). The default is lapack if the code
+ * was built with <tt>make lapack=1</tt>, and reference otherwise
+ * </ul>
+ *
+ * The time spent in each half sweep, how many blocks were read from
+ * memory and from disk and how well they were compressed, and the peak
+ * memory of the arrays are printed in the standard error.
+ *
  * \page people People
  *
  * Roger Melko, Ivan Gonzalez, Ann Kallin, and Kevin Resch
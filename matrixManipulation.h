@@ -33,15 +33,47 @@ inline blitz::Array<double,2> createIdentityMatrix(int rows)
 }
 
 /**
- * @brief A function to reduce a 4-index tensor to a matrix
+ * @brief A function to get the hermitian conjugate of an operator
+ *
+ * @param op a real matrix with the operator
+ * @returns a view of the transpose of op
+ *
+ * Our operators are real, so the hermitian conjugate is just the
+ * transpose. The result shares the memory of op (nothing is copied), so
+ * only one operator of each hermitian pair (like S^+ and S^-) needs to be
+ * stored and transformed. Don't keep the view across a resize of op.
+ */
+inline blitz::Array<double,2> hermitianConjugate(const blitz::Array<double,2>& op)
+{
+    return op.transpose(blitz::secondDim, blitz::firstDim);
+}
+
+/**
+ * @brief A function to check if an array can be reshaped without copying
+ *
+ * @param array the array
+ * @returns true if the elements of the array are stored in row-major
+ * order without gaps, as in a freshly allocated array (but not in a
+ * transpose or a strided slice)
+ */
+template<int N>
+inline bool isStoredRowMajor(const blitz::Array<double,N>& array)
+{
+    bool result=(array.stride(N-1)==1);
+    for (int i=0; i<N-1; i++)
+	result=result && (array.stride(i)==array.stride(i+1)*array.extent(i+1));
+    return result;
+}
+
+/**
+ * @brief A function to view a 4-index tensor as a matrix
  *
- * @param tensor a 4-index tensor to be reduced
- * @returns a matrix with the same elements as the tensor
+ * @param tensor a m,2,m,2 tensor stored in row-major order
+ * @returns a 2m*2m matrix with the same elements as the tensor
  *
- * Reduces a m,2,m,2 matrix to a 2m*2m matrix. We need to do this a few
- * times in the code, as we construct the operators in the hamiltonian in
- * the direct product basis. The basis is written as the direct product of
- * four different basis: 
+ * We need to do this a few times in the code, as we construct the
+ * operators in the hamiltonian in the direct product basis. The basis is
+ * written as the direct product of four different basis: 
  *
  * <ol>
  * <li> the basis for the system block but the last site,
@@ -52,44 +84,75 @@ inline blitz::Array<double,2> createIdentityMatrix(int rows)
  * 
  * Typically we build a 4-index tensor by multiplying the operators for
  * the system block and then use this function to make a matrix out of the
- * tensor (simply rearranging the indexes.) The same proceudre is repeate
- * for the environment. Then the tensor for the system and enviroment
- * is build multiplying these two matrices. Finally the latter tensor is
- * reduced to a matrix by using this function again.
+ * tensor. The same proceudre is repeate for the environment. Then the
+ * tensor for the system and enviroment is build multiplying these two
+ * matrices. Finally the latter tensor is made a matrix by using this
+ * function again.
+ *
+ * The row (a1,a2) of the matrix is a1*2+a2, and the column (a3,a4) is
+ * a3*2+a4. In row-major order that is just how the tensor is stored, so
+ * the result shares the memory of the tensor (nothing is copied.) Don't
+ * keep the view across a resize of the tensor, and copy it if the tensor
+ * is going to be overwritten.
  */
-inline blitz::Array<double,2> reduceM2M2(const blitz::Array<double,4>& tensor)
+inline blitz::Array<double,2> viewAsMatrix(const blitz::Array<double,4>& tensor)
 {
     const int first_dim=tensor.extent(blitz::firstDim);
     const int second_dim=tensor.extent(blitz::secondDim);
 
     if (first_dim!=tensor.extent(blitz::thirdDim))
-	throw dmrg::Exception("reduceTensorToMatrix: wrong dims");
+	throw dmrg::Exception("viewAsMatrix: wrong dims");
 
     if (second_dim!=tensor.extent(blitz::fourthDim))
-	throw dmrg::Exception("reduceTensorToMatrix: wrong dims");
+	throw dmrg::Exception("viewAsMatrix: wrong dims");
+
+    if (!isStoredRowMajor(tensor))
+	throw dmrg::Exception("viewAsMatrix: the tensor is not row-major");
 
     const int matrixDim=first_dim*second_dim;
-      
-    blitz::Array<double,2> result(matrixDim, matrixDim);
+    blitz::Array<double,2> result;
+    result.referenceReshaped(tensor, blitz::shape(matrixDim, matrixDim));
+    return result;
+}
+
+/**
+ * @brief A function to view a vector as a matrix
+ *
+ * @param vector a vector with rows*cols elements, stored without gaps
+ * @param rows the number of rows of the matrix
+ * @param cols the number of columns of the matrix
+ * @returns a matrix whose row r is the elements r*cols to (r+1)*cols-1
+ * of the vector
+ *
+ * The result shares the memory of the vector (nothing is copied.) Use
+ * hermitianConjugate() on it if you need the elements by columns.
+ */
+inline blitz::Array<double,2> viewAsMatrix(const blitz::Array<double,1>& vector,
+	int rows, int cols)
+{
+    if (vector.size()!=rows*cols)
+	throw dmrg::Exception("viewAsMatrix: wrong dims");
+
+    if (!isStoredRowMajor(vector))
+	throw dmrg::Exception("viewAsMatrix: the vector is not contiguous");
 
-    int c;
-    int r=0;
-    for (int a1=0; a1<first_dim; a1++)
-    {
-      for (int a2=0; a2<second_dim; a2++)
-      {
-	  c=0;
-	  for (int a3=0; a3<first_dim; a3++)
-	  {
-	      for (int a4=0; a4<second_dim; a4++)
-	      {
-		  result(r,c) = tensor(a1,a2,a3,a4);
-		  c++;
-	      }
-	  }
-	  r++;    
-      }
-    }
+    blitz::Array<double,2> result;
+    result.referenceReshaped(vector, blitz::shape(rows, cols));
     return result;
 }
+
+/**
+ * @brief A function to reduce a 4-index tensor to a matrix
+ *
+ * @param tensor a m,2,m,2 tensor to be reduced
+ * @returns a 2m*2m matrix with a copy of the elements of the tensor
+ *
+ * Like viewAsMatrix(), but the result has its own memory. To assign the
+ * tensor to a matrix that already has the right size, use viewAsMatrix()
+ * instead and save a copy.
+ */
+inline blitz::Array<double,2> reduceM2M2(const blitz::Array<double,4>& tensor)
+{
+    return viewAsMatrix(tensor).copy();
+}
 #endif // MATRIX_MANIPULATION_H
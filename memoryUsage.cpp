@@ -0,0 +1,160 @@
+/**
+ * @file memoryUsage.cpp
+ *
+ * @brief Implementation of the accounting of the memory of the arrays
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#include <algorithm>
+#include <cmath>
+#include "blitz/array.h"
+#include "memoryUsage.h"
+
+static_assert(MEMORY_TAGS<=blitz::memoryTagCount,
+	"Blitz++ has fewer memory tags than the DMRG");
+
+/**
+ * @brief Constructor: no memory
+ */
+MemoryUsage::MemoryUsage() : totalBytes(0), peakTotalBytes(0)
+{
+    std::fill(bytes, bytes+MEMORY_TAGS, 0);
+    std::fill(peakBytes, peakBytes+MEMORY_TAGS, 0);
+}
+
+/**
+ * @brief A function to follow the peaks over several snapshots
+ *
+ * @param other a later snapshot: its bytes replace these, and its peaks
+ * replace these if they are larger
+ */
+void MemoryUsage::includePeaks(const MemoryUsage& other)
+{
+    for (int tag=0; tag<MEMORY_TAGS; tag++)
+    {
+	bytes[tag]=other.bytes[tag];
+	peakBytes[tag]=std::max(peakBytes[tag], other.peakBytes[tag]);
+    }
+    totalBytes=other.totalBytes;
+    peakTotalBytes=std::max(peakTotalBytes, other.peakTotalBytes);
+}
+
+/**
+ * @brief A function to get the name of a tag, as in the results file
+ */
+const char* memoryTagName(int tag)
+{
+    static const char* names[MEMORY_TAGS]={"other", "superblock",
+	"lanczos", "densityMatrix", "blockOperators", "blockCache"};
+    return (tag>=0 && tag<MEMORY_TAGS)? names[tag] : "unknown";
+}
+
+/**
+ * @brief A function to get the memory of the arrays now
+ *
+ * @param startNewPeaks if true, the peaks start again from the memory
+ * used now, so the next call gives the peaks since this one (e.g. those
+ * of a DMRG step)
+ *
+ * @return the memory of the arrays alive, and the peaks since the start
+ * of the run or the last call that started new peaks
+ */
+MemoryUsage currentMemoryUsage(bool startNewPeaks)
+{
+    blitz::MemoryAccount* accounts=blitz::memoryAccounts();
+    MemoryUsage result;
+    for (int tag=0; tag<MEMORY_TAGS; tag++)
+    {
+	result.bytes[tag]=accounts[tag].bytes();
+	result.peakBytes[tag]=accounts[tag].peakBytes();
+    }
+    blitz::MemoryAccount& total=accounts[blitz::memoryTagCount];
+    result.totalBytes=total.bytes();
+    result.peakTotalBytes=total.peakBytes();
+
+    if (startNewPeaks)
+	for (int tag=0; tag<=blitz::memoryTagCount; tag++)
+	    accounts[tag].resetPeak();
+    return result;
+}
+
+/**
+ * @brief A function to estimate the memory a run needs, before running it
+ *
+ * @param m the number of states kept
+ * @param numberOfSites the number of sites of the chain
+ * @param targets the number of states targeted
+ * @param blockMemory megabytes of blocks the block store keeps in memory
+ *
+ * @return the peaks of the memory of the arrays, by tag and in total,
+ * in the largest step of the run; the current bytes are left as 0
+ *
+ * The estimate follows the arrays of heisenberg.cpp step by step, so it
+ * is close to what the run accounts (see currentMemoryUsage()), usually
+ * a bit above. The memory the array pool keeps between steps, the mapped
+ * blocks and the code itself come on top.
+ */
+MemoryUsage estimateMemoryUsage(int m, int numberOfSites, int targets,
+	double blockMemory)
+{
+    // states of the largest block kept, and of the enlarged block
+    const int halfChain=std::max(numberOfSites/2, 2);
+    const double kept=std::min(double(m), std::pow(2.0, halfChain-1));
+    const double enlarged=2*kept;
+    const double E2=enlarged*enlarged*sizeof(double);
+
+    MemoryUsage result;
+    result.peakBytes[SUPERBLOCK_MEMORY]=size_t(E2*enlarged*enlarged);
+
+    // the workspace (4 vectors and 100 iterations), the new target states
+    // and those of the previous step, still alive
+    result.peakBytes[LANCZOS_MEMORY]=
+	size_t((4+2*targets)*E2+(4*100+100*100)*sizeof(double));
+
+    // the density matrix, a copy to diagonalize and the truncation matrix
+    result.peakBytes[DENSITY_MATRIX_MEMORY]=
+	size_t(2*E2+kept*enlarged*sizeof(double));
+
+    // H, S_z and S_p of the system and environment blocks, and the
+    // transformed operators
+    result.peakBytes[BLOCK_OPERATOR_MEMORY]=size_t(6*E2+
+	    3*kept*kept*sizeof(double));
+
+    // every block Hamiltonian and truncation matrix of both sides, up to
+    // the memory the store keeps
+    double cache=0.0;
+    for (int sites=2; sites<numberOfSites-2; sites++)
+    {
+	const double states=std::min(double(m), std::pow(2.0, sites-1));
+	cache+=2*(4*states*states+2*states*states)*sizeof(double);
+    }
+    result.peakBytes[BLOCK_CACHE_MEMORY]=
+	size_t(std::min(cache, blockMemory*1024*1024));
+
+    for (int tag=0; tag<MEMORY_TAGS; tag++)
+	result.peakTotalBytes+=result.peakBytes[tag];
+    return result;
+}
+
+/**
+ * @brief A function to print the memory of the arrays
+ *
+ * @param os where to print it
+ * @param title what the numbers are
+ * @param usage the memory
+ */
+void printMemoryUsage(std::ostream& os, const char* title,
+	const MemoryUsage& usage)
+{
+    const double MB=1024.0*1024.0;
+    os<<title<<": "<<usage.peakTotalBytes/MB<<" MB at most (";
+    for (int tag=0; tag<MEMORY_TAGS; tag++)
+	os<<(tag>0? ", " : "")<<memoryTagName(tag)<<' '
+	    <<usage.peakBytes[tag]/MB;
+    os<<")\n";
+}
+// end memoryUsage.cpp
@@ -0,0 +1,70 @@
+/**
+ * @file memoryUsage.h
+ *
+ * @brief The accounting of the memory of the arrays by the part of the
+ * DMRG that uses them, and an estimate of it before the run
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <cstddef>
+#include <iostream>
+#include "blitz/array.h"
+
+/**
+ * @brief The parts of the DMRG the memory of the arrays is accounted to
+ *
+ * The arrays allocated inside a blitz::MemoryTagScope with a tag are
+ * accounted to it, the rest to OTHER_MEMORY.
+ */
+enum MemoryTag {
+    /// anything not tagged
+    OTHER_MEMORY,
+    /// the superblock Hamiltonian
+    SUPERBLOCK_MEMORY,
+    /// the Lanczos vectors and the target states
+    LANCZOS_MEMORY,
+    /// the reduced density matrix, its diagonalization and the truncation
+    /// matrix
+    DENSITY_MATRIX_MEMORY,
+    /// the operators of the blocks and the tensors they are built from
+    BLOCK_OPERATOR_MEMORY,
+    /// the blocks kept in memory by the block store
+    BLOCK_CACHE_MEMORY,
+    /// number of tags
+    MEMORY_TAGS
+};
+
+/**
+ * @brief The memory of the arrays, by tag
+ */
+struct MemoryUsage
+{
+    /// bytes of the arrays alive, by tag
+    size_t bytes[MEMORY_TAGS];
+    /// largest bytes[tag] seen, by tag
+    size_t peakBytes[MEMORY_TAGS];
+    /// bytes of all the arrays alive
+    size_t totalBytes;
+    /// largest totalBytes seen. It can be less than the sum of the peaks
+    /// of the tags, as they don't all peak at the same time
+    size_t peakTotalBytes;
+
+    MemoryUsage();
+    void includePeaks(const MemoryUsage& other);
+};
+
+const char* memoryTagName(int tag);
+MemoryUsage currentMemoryUsage(bool startNewPeaks);
+MemoryUsage estimateMemoryUsage(int m, int numberOfSites, int targets,
+	double blockMemory);
+void printMemoryUsage(std::ostream& os, const char* title,
+	const MemoryUsage& usage);
+
+#endif // MEMORY_USAGE_H
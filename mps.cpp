@@ -0,0 +1,265 @@
+/**
+ * @file mps.cpp
+ *
+ * @brief Implementation of the routines that write the state of the chain
+ * as a matrix product state
+ *
+ * The truncation matrices of the blocks are the tensors of a matrix
+ * product state: the truncation matrix of the block of k sites, O(b,
+ * a*d+s), takes the states a of the block of k-1 sites and s of the
+ * added site, with d states per site, to the state b of the block of k sites. Taking them in
+ * order from the ends of the chain, and the wavefunction of the last
+ * superblock in the middle, gives the whole state.
+ *
+ * An MPS file is binary: the magic "DMRGMPS", the version, the number of
+ * sites, the number of states of a site, the center and the energy, and then the tensors from left to
+ * right, each as its shape followed by the elements in row-major order.
+ * It ends with the magic again, to catch truncated files.
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#include <cstring>
+#include <string>
+#include "blitz/array.h"
+#include "exceptions.h"
+#include "binaryFile.h"
+#include "blockStore.h"
+#include "matrixManipulation.h"
+#include "mps.h"
+
+namespace {
+
+/**
+ * @brief Gets the tensors of the sites of a block, from the end of the
+ * chain inwards
+ *
+ * @param store where the truncation matrices are
+ * @param d the number of states of a site
+ * @param side the side of the block, 'l' or 'r'
+ * @param sites the number of sites of the block
+ *
+ * @return the tensors of the first sites-1 sites of the block,
+ * result[k](a,s,b), with a the bond towards the end of the chain. The
+ * last site of the block is the one added to it in the superblock, so it
+ * has no tensor here.
+ */
+std::vector<blitz::Array<double,3> > blockTensors(BlockStore& store,
+	int d, char side, int sites)
+{
+    std::vector<blitz::Array<double,3> > result;
+    blitz::Array<double,2> OO;
+    int previousStates=1;
+    for (int k=1; k<sites; k++)
+    {
+	// a single site is not truncated. As in all the blocks, the site
+	// added to it is the last one (see enlargeBlock())
+	if (k==1)
+	    OO.reference(createIdentityMatrix(d));
+	else
+	    store.getTransformation(k, side, OO);
+	if (OO.cols()!=d*previousStates)
+	    throw dmrg::Exception("buildMatrixProductState: the truncation "
+		    "matrices of the blocks don't match");
+
+	blitz::Array<double,3> tensor(previousStates, d, OO.rows());
+	for (int a=0; a<previousStates; a++)
+	    for (int s=0; s<d; s++)
+		for (int b=0; b<OO.rows(); b++)
+		    tensor(a,s,b)=OO(b,a*d+s);
+	result.push_back(tensor);
+	previousStates=OO.rows();
+    }
+    return result;
+}
+
+}
+
+/**
+ * @brief A function to put together the state of the chain
+ *
+ * @param store the blocks of the run, with their truncation matrices (see
+ * BlockStore::putTransformation())
+ * @param d the number of states of a site
+ * @param sitesInLeft number of sites of the left block of the superblock
+ * @param sitesInRight number of sites of the right block
+ * @param psi the wavefunction of the superblock as a matrix: the rows are
+ * the states of the left block, the columns those of the right block
+ *
+ * @return the state as a matrix product state, with the center on the
+ * last site of the left block. The energy is left as 0.
+ *
+ * The left block is the block of side 'l' of sitesInLeft sites, and the
+ * right block the block of side 'r' of sitesInRight sites, and the
+ * truncation matrices in the store must be the ones that built them.
+ * Throws a dmrg::Exception if they are not in the store or don't match
+ * psi.
+ */
+MatrixProductState buildMatrixProductState(BlockStore& store, int d,
+	int sitesInLeft, int sitesInRight, const blitz::Array<double,2>& psi)
+{
+    if (sitesInLeft<1 || sitesInRight<1)
+	throw dmrg::Exception("buildMatrixProductState: empty block");
+    if (d<1)
+	throw dmrg::Exception("buildMatrixProductState: wrong site states");
+
+    MatrixProductState result;
+    result.siteStates=d;
+    result.tensors=blockTensors(store, d, 'l', sitesInLeft);
+    std::vector<blitz::Array<double,3> > right=
+	blockTensors(store, d, 'r', sitesInRight);
+
+    const int leftStates=result.tensors.empty()? 1 : 
+	result.tensors.back().extent(blitz::thirdDim);
+    const int rightStates=right.empty()? 1 : 
+	right.back().extent(blitz::thirdDim);
+    if (psi.rows()!=d*leftStates || psi.cols()!=d*rightStates)
+	throw dmrg::Exception("buildMatrixProductState: psi doesn't match "
+		"the blocks");
+
+    // the wavefunction goes in the last site of the left block ...
+    blitz::Array<double,3> center(leftStates, d, psi.cols());
+    for (int a=0; a<leftStates; a++)
+	for (int s=0; s<d; s++)
+	    for (int c=0; c<psi.cols(); c++)
+		center(a,s,c)=psi(a*d+s,c);
+    result.center=result.tensors.size();
+    result.tensors.push_back(center);
+
+    // ... and the first site of the right block just splits its states
+    blitz::Array<double,3> split(psi.cols(), d, rightStates);
+    split=0.0;
+    for (int b=0; b<rightStates; b++)
+	for (int s=0; s<d; s++)
+	    split(b*d+s,s,b)=1.0;
+    result.tensors.push_back(split);
+
+    // the right block goes from the right end of the chain inwards
+    for (int k=right.size()-1; k>=0; k--)
+    {
+	blitz::Array<double,3> tensor(right[k].extent(blitz::thirdDim), d,
+		right[k].extent(blitz::firstDim));
+	tensor=right[k].transpose(blitz::thirdDim, blitz::secondDim,
+		blitz::firstDim);
+	result.tensors.push_back(tensor);
+    }
+    return result;
+}
+
+/**
+ * @brief A function to calculate the overlap of two states
+ *
+ * @param bra a state of the chain
+ * @param ket another state of the same chain
+ *
+ * @return the overlap of the two states; with bra and ket the same,
+ * their norm squared
+ */
+double overlap(const MatrixProductState& bra, const MatrixProductState& ket)
+{
+    if (bra.tensors.size()!=ket.tensors.size() ||
+	    bra.siteStates!=ket.siteStates)
+	throw dmrg::Exception("overlap: the states have different sizes");
+
+    // contract the chain from left to right
+    blitz::Array<double,2> E(1,1);
+    E=1.0;
+    for (size_t n=0; n<bra.tensors.size(); n++)
+    {
+	const blitz::Array<double,3>& A=bra.tensors[n];
+	const blitz::Array<double,3>& B=ket.tensors[n];
+	if (A.extent(blitz::firstDim)!=E.rows() ||
+		B.extent(blitz::firstDim)!=E.cols() ||
+		A.extent(blitz::secondDim)!=B.extent(blitz::secondDim))
+	    throw dmrg::Exception("overlap: the tensors don't match");
+
+	blitz::Array<double,2> next(A.extent(blitz::thirdDim),
+		B.extent(blitz::thirdDim));
+	next=0.0;
+	for (int a=0; a<E.rows(); a++)
+	    for (int a2=0; a2<E.cols(); a2++)
+		for (int s=0; s<A.extent(blitz::secondDim); s++)
+		    for (int b=0; b<next.rows(); b++)
+			for (int b2=0; b2<next.cols(); b2++)
+			    next(b,b2)+=E(a,a2)*A(a,s,b)*B(a2,s,b2);
+	E.reference(next);
+    }
+    return E(0,0);
+}
+
+/**
+ * @brief A function to save a matrix product state
+ *
+ * @param fname the name of the file
+ * @param mps the state
+ */
+void writeMatrixProductState(const std::string& fname,
+	const MatrixProductState& mps)
+{
+    BinaryFile out(fname, "wb");
+    if (!out.ok)
+	throw dmrg::Exception("writeMatrixProductState: can't open "+fname);
+
+    out.write("DMRGMPS", 8);
+    out.write(MPS_FILE_VERSION);
+    out.write(int32_t(mps.tensors.size()));
+    out.write(int32_t(mps.siteStates));
+    out.write(int32_t(mps.center));
+    out.write(mps.energy);
+    for (size_t n=0; n<mps.tensors.size(); n++)
+	out.write(mps.tensors[n]);
+    out.write("DMRGMPS", 8);
+
+    if (!out.close())
+	throw dmrg::Exception("writeMatrixProductState: can't write "+fname);
+}
+
+/**
+ * @brief A function to read a matrix product state
+ *
+ * @param fname the name of the file, written by writeMatrixProductState()
+ * @param mps on return, the state
+ *
+ * Throws a dmrg::Exception if the file is not a valid MPS file.
+ */
+void readMatrixProductState(const std::string& fname,
+	MatrixProductState& mps)
+{
+    BinaryFile in(fname, "rb");
+    if (!in.ok)
+	throw dmrg::Exception("readMatrixProductState: can't open "+fname);
+
+    char magic[8];
+    uint32_t version=0;
+    in.read(magic, 8);
+    in.read(version);
+    if (!in.ok || memcmp(magic, "DMRGMPS", 8)!=0 ||
+	    version!=MPS_FILE_VERSION)
+	throw dmrg::Exception("readMatrixProductState: not an MPS file: "+
+		fname);
+
+    // the number of sites, the states of a site and the center
+    int32_t value[3]={0, 0, 0};
+    in.read(value, sizeof(value));
+    in.read(mps.energy);
+    if (value[0]<1 || value[1]<1 || value[2]<0 || value[2]>=value[0])
+	in.ok=false;
+    mps.tensors.resize(in.ok? value[0] : 0);
+    mps.siteStates=value[1];
+    mps.center=value[2];
+    int bond=1;
+    for (size_t n=0; n<mps.tensors.size() && in.ok; n++)
+    {
+	in.read(mps.tensors[n]);
+	in.ok=in.ok && mps.tensors[n].extent(blitz::firstDim)==bond &&
+	    mps.tensors[n].extent(blitz::secondDim)==mps.siteStates;
+	bond=mps.tensors[n].extent(blitz::thirdDim);
+    }
+    in.read(magic, 8);
+    if (!in.ok || bond!=1 || memcmp(magic, "DMRGMPS", 8)!=0)
+	throw dmrg::Exception("readMatrixProductState: corrupted file "+fname);
+}
+// end mps.cpp
@@ -0,0 +1,62 @@
+/**
+ * @file mps.h
+ *
+ * @brief Interface for the routines that write the state of the chain as
+ * a matrix product state
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#ifndef MPS_H
+#define MPS_H
+
+#include <string>
+#include <vector>
+#include "blitz/array.h"
+#include "blockStore.h"
+
+/// current version of the MPS file format
+const uint32_t MPS_FILE_VERSION=2;
+
+/**
+ * @brief A state of the chain as a matrix product state
+ *
+ * tensors[n](a,s,b) is the tensor of site n (counting from 0 at the left
+ * end of the chain): s is the state of the site, from 0 to siteStates-1
+ * (for a spin 1/2, 0 up and 1 down), and a, b the bonds to the sites on its left and right. The first and the last
+ * bond have dimension one, so the amplitude of a configuration is the
+ * product of the matrices tensors[n](:,s_n,:).
+ *
+ * The tensors left of center are left-normalized and the ones right of
+ * it right-normalized, so the norm of the state is the norm of
+ * tensors[center].
+ */
+struct MatrixProductState
+{
+    /// the tensors, one per site
+    std::vector<blitz::Array<double,3> > tensors;
+    /// the number of states of a site, d
+    int siteStates;
+    /// the site whose tensor is not normalized
+    int center;
+    /// the energy of the state
+    double energy;
+
+    MatrixProductState() : siteStates(2), center(0), energy(0.0) {}
+};
+
+MatrixProductState buildMatrixProductState(BlockStore& store, int d,
+	int sitesInLeft, int sitesInRight, const blitz::Array<double,2>& psi);
+
+double overlap(const MatrixProductState& bra, const MatrixProductState& ket);
+
+void writeMatrixProductState(const std::string& fname,
+	const MatrixProductState& mps);
+
+void readMatrixProductState(const std::string& fname,
+	MatrixProductState& mps);
+
+#endif // MPS_H
@@ -0,0 +1,326 @@
+/**
+ * @file results.cpp
+ *
+ * @brief Implementation of the file where the results are streamed
+ *
+ * A binary results file starts with the magic "DMRGLOG", the version and
+ * the size of a record (176 bytes), all as in memory. Each record has
+ * six 32-bit integers: the half sweep, the sites in the left and right
+ * blocks, the states kept, the Lanczos iterations and a zero, or 1 in
+ * the record of markRestart(), which has only the half sweep; then
+ * five doubles: the energy, the truncation error and the seconds spent
+ * in the Lanczos, the truncation and the whole step; and then two sets
+ * of seven 64-bit integers, the bytes of the arrays at the end of the
+ * step and their peak during it, for each MemoryTag in order and in
+ * total.
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "exceptions.h"
+#include "main_helpers.h"
+#include "results.h"
+
+namespace {
+
+/// a record of the binary format
+struct BinaryStepRecord
+{
+    int32_t halfSweep;
+    int32_t sitesInLeft;
+    int32_t sitesInRight;
+    int32_t keptStates;
+    int32_t lanczosIterations;
+    int32_t restart;
+    double energy;
+    double truncationError;
+    double lanczosSeconds;
+    double truncationSeconds;
+    double stepSeconds;
+    uint64_t memoryBytes[MEMORY_TAGS+1];
+    uint64_t peakMemoryBytes[MEMORY_TAGS+1];
+};
+
+/// appends to line the bytes of each tag, and the total, as a JSON object
+void appendMemoryBytes(std::string& line, const size_t* bytes, 
+	size_t totalBytes)
+{
+    char value[64];
+    for (int tag=0; tag<MEMORY_TAGS; tag++)
+    {
+	snprintf(value, sizeof(value), "%s\"%s\":%zu", tag>0? "," : "{",
+		memoryTagName(tag), bytes[tag]);
+	line+=value;
+    }
+    snprintf(value, sizeof(value), ",\"total\":%zu}", totalBytes);
+    line+=value;
+}
+
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param fileName the file where the results go
+ * @param format JSON_LINES or BINARY
+ * @param append if true, the records go after those already in the file,
+ * e.g. when a run is resumed from a checkpoint. Otherwise the file is
+ * overwritten
+ * @param bufferBytes the buffer is written when it has this many bytes
+ * @param flushSeconds the buffer is written when the oldest record in it
+ * is this old, so the file follows the run
+ *
+ * When appending to a binary file, its header must be the one this
+ * version writes, and it is not written again.
+ */
+ResultsSink::ResultsSink(const std::string& fileName, Format format,
+	bool append, size_t bufferBytes, double flushSeconds)
+    : fileName(fileName), format(format),
+    file(fopen(fileName.c_str(), append? "ab" : "wb")), 
+    bufferBytes(bufferBytes), flushSeconds(flushSeconds), 
+    lastHandOver(wallTime()), writing(false), stopOutput(false)
+{
+    if (!file)
+	throw dmrg::Exception("ResultsSink: can't open "+fileName);
+
+    const uint32_t header[2]={RESULTS_FILE_VERSION, 
+	sizeof(BinaryStepRecord)};
+    fseek(file, 0, SEEK_END);
+    const bool empty=(ftell(file)==0);
+    if (format==BINARY && !empty)
+    {
+	// only when appending: check that the records are alike
+	char magic[8];
+	uint32_t oldHeader[2]={0, 0};
+	FILE* in=fopen(fileName.c_str(), "rb");
+	const bool ok=in && fread(magic, 1, 8, in)==8 &&
+	    fread(oldHeader, sizeof(oldHeader), 1, in)==1 &&
+	    memcmp(magic, "DMRGLOG", 8)==0 &&
+	    memcmp(oldHeader, header, sizeof(header))==0;
+	if (in)
+	    fclose(in);
+	if (!ok)
+	{
+	    fclose(file);
+	    throw dmrg::Exception("ResultsSink: can't append to "+fileName+
+		    ": it is not a results file of this version");
+	}
+    }
+    if (format==BINARY && empty)
+    {
+	buffer.append("DMRGLOG", 8);
+	buffer.append(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+    outputThread=std::thread(&ResultsSink::outputLoop, this);
+}
+
+/**
+ * @brief Destructor: writes what is left and closes the file
+ */
+ResultsSink::~ResultsSink()
+{
+    try
+    {
+	flush();
+    }
+    catch (std::exception& e)
+    {
+	std::cerr<<e.what()<<'\n';
+    }
+
+    {
+	std::lock_guard<std::mutex> lock(outputMutex);
+	stopOutput=true;
+    }
+    outputCondition.notify_all();
+    outputThread.join();
+    fclose(file);
+}
+
+/**
+ * @brief A function to save the results of a step
+ *
+ * Throws a dmrg::Exception if writing the previous records failed.
+ */
+void ResultsSink::record(const StepRecord& step)
+{
+    std::string data;
+    if (format==BINARY)
+    {
+	BinaryStepRecord binary;
+	memset(&binary, 0, sizeof(binary));
+	binary.halfSweep=step.halfSweep;
+	binary.sitesInLeft=step.sitesInLeft;
+	binary.sitesInRight=step.sitesInRight;
+	binary.keptStates=step.keptStates;
+	binary.lanczosIterations=step.lanczosIterations;
+	binary.energy=step.energy;
+	binary.truncationError=step.truncationError;
+	binary.lanczosSeconds=step.lanczosSeconds;
+	binary.truncationSeconds=step.truncationSeconds;
+	binary.stepSeconds=step.stepSeconds;
+	for (int tag=0; tag<MEMORY_TAGS; tag++)
+	{
+	    binary.memoryBytes[tag]=step.memory.bytes[tag];
+	    binary.peakMemoryBytes[tag]=step.memory.peakBytes[tag];
+	}
+	binary.memoryBytes[MEMORY_TAGS]=step.memory.totalBytes;
+	binary.peakMemoryBytes[MEMORY_TAGS]=step.memory.peakTotalBytes;
+	data.append(reinterpret_cast<const char*>(&binary), sizeof(binary));
+    }
+    else
+    {
+	char line[512];
+	snprintf(line, sizeof(line), "{\"halfSweep\":%d,\"sitesInLeft\":%d,"
+		"\"sitesInRight\":%d,\"energy\":%.17g,"
+		"\"truncationError\":%.17g,\"keptStates\":%d,"
+		"\"lanczosIterations\":%d,\"lanczosSeconds\":%.6g,"
+		"\"truncationSeconds\":%.6g,\"stepSeconds\":%.6g,"
+		"\"memoryBytes\":",
+		step.halfSweep, step.sitesInLeft, step.sitesInRight,
+		step.energy, step.truncationError, step.keptStates,
+		step.lanczosIterations, step.lanczosSeconds,
+		step.truncationSeconds, step.stepSeconds);
+	data.append(line);
+	appendMemoryBytes(data, step.memory.bytes, step.memory.totalBytes);
+	data.append(",\"peakMemoryBytes\":");
+	appendMemoryBytes(data, step.memory.peakBytes, 
+		step.memory.peakTotalBytes);
+	data.append("}\n");
+    }
+    append(data);
+}
+
+/**
+ * @brief A function to mark where a resumed run starts
+ *
+ * @param halfSweep the half sweep the run is resumed in
+ *
+ * Writes a record with only the half sweep: {"restart":true,"halfSweep":
+ * ...} in JSON, or a binary record with restart set to 1. The steps
+ * recorded by the previous run after its last checkpoint come again
+ * after it.
+ */
+void ResultsSink::markRestart(int halfSweep)
+{
+    std::string data;
+    if (format==BINARY)
+    {
+	BinaryStepRecord binary;
+	memset(&binary, 0, sizeof(binary));
+	binary.halfSweep=halfSweep;
+	binary.restart=1;
+	data.append(reinterpret_cast<const char*>(&binary), sizeof(binary));
+    }
+    else
+    {
+	char line[64];
+	snprintf(line, sizeof(line), "{\"restart\":true,\"halfSweep\":%d}\n",
+		halfSweep);
+	data.append(line);
+    }
+    append(data);
+}
+
+/**
+ * @brief A function to wait until all the records are in the file
+ *
+ * Throws a dmrg::Exception if writing them failed.
+ */
+void ResultsSink::flush()
+{
+    std::unique_lock<std::mutex> lock(outputMutex);
+    handOver();
+    outputCondition.notify_all();
+    while (!pending.empty() || writing)
+	outputCondition.wait(lock);
+    if (!error.empty())
+	throw dmrg::Exception(error);
+}
+
+/**
+ * @brief Adds formatted records to the buffer, and queues it for the
+ * background thread when it is full
+ *
+ * Throws a dmrg::Exception if writing the previous records failed.
+ */
+void ResultsSink::append(const std::string& data)
+{
+    {
+	std::lock_guard<std::mutex> lock(outputMutex);
+	if (!error.empty())
+	    throw dmrg::Exception(error);
+	buffer+=data;
+	if (buffer.size()<bufferBytes)
+	    return;
+	handOver();
+    }
+    outputCondition.notify_all();
+}
+
+/**
+ * @brief Queues the buffer for the background thread
+ *
+ * outputMutex must be locked.
+ */
+void ResultsSink::handOver()
+{
+    lastHandOver=wallTime();
+    if (buffer.empty())
+	return;
+    pending.push_back(std::string());
+    pending.back().swap(buffer);
+}
+
+/**
+ * @brief The loop of the background thread: writes the queued buffers
+ * until the sink is destroyed
+ *
+ * It also takes the buffer itself when it has not been handed over for
+ * flushSeconds, so the records reach the file even if the run stops
+ * recording, e.g. in a long step or when it is killed.
+ */
+void ResultsSink::outputLoop()
+{
+    std::unique_lock<std::mutex> lock(outputMutex);
+    while (true)
+    {
+	while (pending.empty() && !stopOutput)
+	{
+	    const double age=wallTime()-lastHandOver;
+	    if (!buffer.empty() && age>=flushSeconds)
+	    {
+		handOver();
+		break;
+	    }
+	    // an empty buffer may get records at any time: wait a whole
+	    // period for them
+	    outputCondition.wait_for(lock, std::chrono::duration<double>(
+			buffer.empty()? flushSeconds : flushSeconds-age));
+	}
+	if (pending.empty())
+	    return;
+
+	std::string data;
+	data.swap(pending.front());
+	pending.pop_front();
+	writing=true;
+	lock.unlock();
+	const bool ok=fwrite(data.data(), data.size(), 1, file)==1 &&
+	    fflush(file)==0;
+	lock.lock();
+	writing=false;
+	if (!ok && error.empty())
+	    error="ResultsSink: can't write "+fileName;
+	outputCondition.notify_all();
+    }
+}
+// end results.cpp
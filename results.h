@@ -0,0 +1,131 @@
+/**
+ * @file results.h
+ *
+ * @brief A class that streams the results of each DMRG step to a file
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <stdint.h>
+#include "memoryUsage.h"
+
+/// current version of the binary results format
+const uint32_t RESULTS_FILE_VERSION=3;
+
+/**
+ * @brief What is saved of each step of the DMRG
+ */
+struct StepRecord
+{
+    /// half sweep of the finite system algorithm, -1 in the infinite
+    /// system algorithm
+    int halfSweep;
+    /// number of sites of the left block
+    int sitesInLeft;
+    /// number of sites of the right block
+    int sitesInRight;
+    /// energy of the ground state (not per site)
+    double energy;
+    /// sum of the density matrix eigenvalues of the states thrown away
+    double truncationError;
+    /// number of states kept in the truncated block
+    int keptStates;
+    /// number of Lanczos iterations, for all the targets together
+    int lanczosIterations;
+    /// seconds spent in the Lanczos
+    double lanczosSeconds;
+    /// seconds spent calculating and truncating the density matrix
+    double truncationSeconds;
+    /// seconds spent in the whole step
+    double stepSeconds;
+    /// memory of the arrays at the end of the step, and its peaks during
+    /// the step
+    MemoryUsage memory;
+
+    StepRecord() : halfSweep(-1), sitesInLeft(0), sitesInRight(0),
+	energy(0.0), truncationError(0.0), keptStates(0),
+	lanczosIterations(0), lanczosSeconds(0.0), truncationSeconds(0.0),
+	stepSeconds(0.0) {}
+};
+
+/**
+ * @brief A file where the results of the run are streamed, one record
+ * per DMRG step
+ *
+ * Records are written as JSON lines, one object per line with the
+ * fields of StepRecord, or in a compact binary format: the magic
+ * "DMRGLOG", the version and the size of a record, followed by the
+ * records (see results.cpp.)
+ *
+ * record() only formats the step into a buffer. When the buffer is full,
+ * or some time after the last write, a background thread writes it to
+ * the file, so the DMRG never waits for the disk. flush() waits until
+ * everything recorded is in the file.
+ *
+ * A resumed run calls markRestart() before its first record: the steps
+ * after the checkpoint may be in the file twice, before and after the
+ * mark.
+ */
+class ResultsSink {
+    public:
+	/// the format of the file
+	enum Format { JSON_LINES, BINARY };
+
+	ResultsSink(const std::string& fileName, Format format,
+		bool append=false, size_t bufferBytes=65536, 
+		double flushSeconds=1.0);
+	~ResultsSink();
+
+	void record(const StepRecord& step);
+	void markRestart(int halfSweep);
+	void flush();
+
+    private:
+	std::string fileName;
+	Format format;
+	FILE* file;
+	/// hand the buffer over when it is this large ...
+	size_t bufferBytes;
+	/// ... or when it is this old
+	double flushSeconds;
+
+	/// @name Background output
+	/// everything here is guarded by outputMutex
+	//@{
+	/// the records not handed to the background thread yet
+	std::string buffer;
+	/// when the buffer was last handed over
+	double lastHandOver;
+	std::deque<std::string> pending;
+	/// true while the background thread is writing
+	bool writing;
+	/// the error message if writing failed
+	std::string error;
+	bool stopOutput;
+	std::mutex outputMutex;
+	std::condition_variable outputCondition;
+	std::thread outputThread;
+	//@}
+
+	void append(const std::string& data);
+	void handOver();
+	void outputLoop();
+
+	// not copyable
+	ResultsSink(const ResultsSink&);
+	void operator=(const ResultsSink&);
+};
+
+#endif // RESULTS_H
@@ -0,0 +1,278 @@
+/**
+ * @file siteOperators.h
+ * @brief The operators of a single site, and the kernels that add a site
+ * to a block and join two enlarged blocks into the superblock
+ *
+ * The kernels are templates on the local dimension d, the number of
+ * states of a site (2 for a spin-1/2, 3 for a spin-1, 4 for a Hubbard
+ * site). It is fixed at compile time, so the site operators live in
+ * registers and the loops over the states of the sites are unrolled.
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#ifndef SITE_OPERATORS_H
+#define SITE_OPERATORS_H
+
+#include <algorithm>
+#include <vector>
+#include "blitz/array.h"
+#include "blitz/tinymat.h"
+#include "exceptions.h"
+#include "matrixManipulation.h"
+
+/**
+ * @brief An operator on a single site with d states
+ */
+template<int d>
+using SiteOperator=blitz::TinyMatrix<double,d,d>;
+
+/**
+ * @brief A function to create the identity on a site
+ */
+template<int d>
+inline SiteOperator<d> siteIdentity()
+{
+    SiteOperator<d> result;
+    result.initialize(0.0);
+    for (int s=0; s<d; s++)
+	result(s,s)=1.0;
+    return result;
+}
+
+/**
+ * @brief A function to get the hermitian conjugate of a site operator
+ *
+ * As for the operators of the blocks, it is just the transpose.
+ */
+template<int d>
+inline SiteOperator<d> hermitianConjugate(const SiteOperator<d>& op)
+{
+    SiteOperator<d> result;
+    for (int s=0; s<d; s++)
+	for (int t=0; t<d; t++)
+	    result(s,t)=op(t,s);
+    return result;
+}
+
+/**
+ * @brief A function to make a matrix out of a site operator
+ *
+ * @param op the site operator
+ * @returns a d*d matrix with a copy of op, e.g. the operator of a block
+ * of a single site
+ */
+template<int d>
+inline blitz::Array<double,2> siteOperatorMatrix(const SiteOperator<d>& op)
+{
+    blitz::Array<double,2> result(d,d);
+    for (int s=0; s<d; s++)
+	for (int t=0; t<d; t++)
+	    result(s,t)=op(s,t);
+    return result;
+}
+
+/**
+ * @brief A term of the Hamiltonian (or of an operator) of an enlarged
+ * block: factor times an operator of the block times an operator of the
+ * site added to it
+ */
+template<int d>
+struct SiteProduct
+{
+    double factor;
+    /// the operator of the block, empty for the identity. It can be a
+    /// view, like a hermitianConjugate()
+    blitz::Array<double,2> blockOperator;
+    SiteOperator<d> siteOperator;
+
+    SiteProduct(double factor, const blitz::Array<double,2>& blockOperator,
+	    const SiteOperator<d>& siteOperator)
+	: factor(factor), blockOperator(blockOperator), 
+	siteOperator(siteOperator) {}
+
+    /// factor times the identity on the block times siteOperator
+    SiteProduct(double factor, const SiteOperator<d>& siteOperator)
+	: factor(factor), siteOperator(siteOperator) {}
+};
+
+/**
+ * @brief A function to build an operator of a block enlarged by a site
+ *
+ * @param result where the operator goes, resized to d*states x d*states.
+ * The element (a*d+s,b*d+t) is the sum over the terms of
+ * factor*blockOperator(a,b)*siteOperator(s,t), i.e. the basis of the
+ * enlarged block is that of the block times that of the site, with the
+ * site last
+ * @param states the number of states of the block
+ * @param terms the terms of the operator
+ *
+ * Each d x d tile of the result is summed up in registers over all the
+ * terms and written once, straight from the operators of the block and
+ * the site, with no tensor in between. The identity terms only touch the
+ * tiles on the diagonal. Rows of tiles are shared among threads.
+ */
+template<int d>
+void enlargeBlock(blitz::Array<double,2>& result, int states,
+	const std::vector<SiteProduct<d> >& terms)
+{
+    for (size_t n=0; n<terms.size(); n++)
+    {
+	const blitz::Array<double,2>& op=terms[n].blockOperator;
+	if (op.numElements()!=0 && (op.rows()!=states || op.cols()!=states))
+	    throw dmrg::Exception("enlargeBlock: wrong dims");
+    }
+
+    const int rows=d*states;
+    result.resize(rows, rows);
+    if (!isStoredRowMajor(result))
+	throw dmrg::Exception("enlargeBlock: result is not row-major");
+    double* r=result.data();
+
+#pragma omp parallel for schedule(static)
+    for (int a=0; a<states; a++)
+	for (int b=0; b<states; b++)
+	{
+	    double tile[d][d]={};
+	    for (size_t n=0; n<terms.size(); n++)
+	    {
+		const SiteProduct<d>& term=terms[n];
+		double x;
+		if (term.blockOperator.numElements()!=0)
+		    x=term.factor*term.blockOperator(a,b);
+		else if (a==b)
+		    x=term.factor;
+		else
+		    continue;
+		for (int s=0; s<d; s++)
+		    for (int t=0; t<d; t++)
+			tile[s][t]+=x*term.siteOperator(s,t);
+	    }
+	    for (int s=0; s<d; s++)
+	    {
+		double* row=r+size_t(a*d+s)*rows+b*d;
+		for (int t=0; t<d; t++)
+		    row[t]=tile[s][t];
+	    }
+	}
+}
+
+/**
+ * @brief Same as above for an operator with a single term, e.g. an
+ * operator of the site added to the block
+ */
+template<int d>
+void enlargeBlock(blitz::Array<double,2>& result, int states,
+	const SiteProduct<d>& term)
+{
+    enlargeBlock(result, states, std::vector<SiteProduct<d> >(1, term));
+}
+
+/**
+ * @brief A term of the interaction between the two sites in the middle
+ * of the superblock: factor times left on the last site of the left
+ * block and right on the last site of the right block
+ */
+template<int d>
+struct SiteCoupling
+{
+    double factor;
+    SiteOperator<d> left;
+    SiteOperator<d> right;
+
+    SiteCoupling(double factor, const SiteOperator<d>& left,
+	    const SiteOperator<d>& right)
+	: factor(factor), left(left), right(right) {}
+};
+
+/**
+ * @brief A function to build the superblock Hamiltonian
+ *
+ * @param Habcd a n1,n2,n1,n2 tensor stored in row-major order, where the
+ * Hamiltonian goes. The element (i,j,k,l) is H(i,k) of the left block
+ * times the identity on the right block, plus the identity on the left
+ * block times H(j,l) of the right block, plus the couplings
+ * @param leftH the n1 x n1 Hamiltonian of the left enlarged block
+ * @param rightH the n2 x n2 Hamiltonian of the right enlarged block
+ * @param couplings the terms of the interaction between the last sites
+ * of both enlarged blocks
+ *
+ * The basis of each enlarged block is the direct product of the basis of
+ * the block and that of its last site, with the site last (as in
+ * enlargeBlock()), so the operators of the last site are the identity
+ * on the block times a site operator. Each coupling then only touches
+ * the elements with the same block states on both sides: d^4 elements
+ * for each pair of block states, instead of the whole tensor. The terms
+ * are added in the same order as the Blitz++ expression
+ * <tt>H1(i,k)*I(j,l)+I(i,k)*H2(j,l)+S1(i,k)*S2(j,l)+...</tt> would, so
+ * the result is the same.
+ */
+template<int d>
+void buildSuperblock(blitz::Array<double,4>& Habcd,
+	const blitz::Array<double,2>& leftH,
+	const blitz::Array<double,2>& rightH,
+	const std::vector<SiteCoupling<d> >& couplings)
+{
+    const int n1=leftH.rows();
+    const int n2=rightH.rows();
+    if (n1%d!=0 || n2%d!=0 || leftH.cols()!=n1 || rightH.cols()!=n2)
+	throw dmrg::Exception("buildSuperblock: wrong dims");
+
+    if (Habcd.extent(blitz::firstDim)!=n1 ||
+	    Habcd.extent(blitz::secondDim)!=n2 ||
+	    Habcd.extent(blitz::thirdDim)!=n1 ||
+	    Habcd.extent(blitz::fourthDim)!=n2)
+	throw dmrg::Exception("buildSuperblock: wrong dims");
+
+    if (!isStoredRowMajor(Habcd))
+	throw dmrg::Exception("buildSuperblock: Habcd is not row-major");
+
+    // strides of i, j and k in Habcd; that of l is 1
+    const size_t strideK=n2;
+    const size_t strideJ=size_t(n1)*n2;
+    const size_t strideI=strideJ*n2;
+    double* h=Habcd.data();
+
+    // each thread builds the rows i=a*d+s of the block states a it gets
+#pragma omp parallel for schedule(static)
+    for (int a=0; a<n1/d; a++)
+    {
+	for (int s=0; s<d; s++)
+	{
+	    const int i=a*d+s;
+	    double* slab=h+i*strideI;
+	    std::fill(slab, slab+strideI, 0.0);
+
+	    for (int j=0; j<n2; j++)
+		for (int k=0; k<n1; k++)
+		    slab[j*strideJ+k*strideK+j]+=leftH(i,k);
+
+	    for (int j=0; j<n2; j++)
+	    {
+		double* row=slab+j*strideJ+i*strideK;
+		for (int l=0; l<n2; l++)
+		    row[l]+=rightH(j,l);
+	    }
+	}
+
+	for (size_t n=0; n<couplings.size(); n++)
+	{
+	    const SiteCoupling<d>& coupling=couplings[n];
+	    for (int c=0; c<n2/d; c++)
+		for (int s=0; s<d; s++)
+		    for (int t=0; t<d; t++)
+		    {
+			const double x=coupling.factor*coupling.left(s,t);
+			double* element=h+(a*d+s)*strideI+(a*d+t)*strideK+
+			    c*d*(strideJ+1);
+			for (int u=0; u<d; u++)
+			    for (int v=0; v<d; v++)
+				element[u*strideJ+v]+=x*coupling.right(u,v);
+		    }
+	}
+    }
+}
+#endif // SITE_OPERATORS_H
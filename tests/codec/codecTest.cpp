@@ -0,0 +1,209 @@
+/**
+ * @file codecTest.cpp
+ *
+ * @brief A test of the compression of the blocks
+ *
+ * Compresses and decompresses blocks of different sizes with
+ * compressBlock() and decompressBlock(): no elements, one, part of a
+ * chunk and several chunks, smooth and incompressible. They must come
+ * back exactly, and truncated or damaged data must be rejected. It also
+ * writes compressed blocks to a BlockArchive with and without a lossy
+ * threshold and reads them back. Run it through
+ *
+ * \code $ make check \endcode
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "blitz/array.h"
+#include "exceptions.h"
+#include "blockCodec.h"
+#include "blockArchive.h"
+
+/// elements that vary slowly, like those of a block Hamiltonian
+std::vector<double> smoothData(size_t n)
+{
+    std::vector<double> data(n);
+    for (size_t i=0; i<n; i++)
+	data[i]=0.25*cos(0.001*i)-0.5*(i%7==0);
+    return data;
+}
+
+/// random bits: nothing to compress
+std::vector<double> randomData(size_t n)
+{
+    std::vector<double> data(n);
+    uint64_t state=12345;
+    for (size_t i=0; i<n; i++)
+    {
+	// NaNs would not compare equal
+	do
+	{
+	    state=state*6364136223846793005ull+1442695040888963407ull;
+	    const uint64_t bits=state^(state>>29);
+	    memcpy(&data[i], &bits, sizeof(double));
+	} while (std::isnan(data[i]));
+    }
+    return data;
+}
+
+/// true if decompressBlock() rejects the compressed data
+bool rejected(const std::vector<char>& compressed, size_t n)
+{
+    std::vector<double> result(n);
+    try
+    {
+	decompressBlock(compressed.data(), compressed.size(), result.data(), n);
+    }
+    catch (const dmrg::Exception&)
+    {
+	return true;
+    }
+    return false;
+}
+
+/**
+ * @brief A function to check a compressed block
+ *
+ * @return true if the block comes back exactly, and truncated data or a
+ * wrong number of elements are rejected
+ */
+bool checkRoundTrip(const std::string& name, const std::vector<double>& data)
+{
+    const size_t n=data.size();
+    std::vector<char> compressed;
+    compressBlock(data.data(), n, compressed);
+
+    std::vector<double> result(n, -1.0);
+    decompressBlock(compressed.data(), compressed.size(), result.data(), n);
+
+    std::cout<<name<<": "<<n<<" elements, "<<n*sizeof(double)<<" bytes, "
+	<<compressed.size()<<" compressed"<<std::endl;
+
+    bool ok=true;
+    if (n>0 && memcmp(result.data(), data.data(), n*sizeof(double))!=0)
+    {
+	std::cout<<"FAILED: the elements are not the same"<<std::endl;
+	ok=false;
+    }
+
+    std::vector<char> truncated(compressed.begin(), compressed.end()-1);
+    if (!rejected(truncated, n))
+    {
+	std::cout<<"FAILED: a truncated block is accepted"<<std::endl;
+	ok=false;
+    }
+    if (!rejected(compressed, n+CODEC_CHUNK))
+    {
+	std::cout<<"FAILED: the wrong number of elements is accepted"
+	    <<std::endl;
+	ok=false;
+    }
+    if (n>0)
+    {
+	// a chunk that says it is longer than it is
+	std::vector<char> damaged(compressed);
+	uint32_t length;
+	memcpy(&length, &damaged[sizeof(uint32_t)], sizeof(length));
+	length++;
+	memcpy(&damaged[sizeof(uint32_t)], &length, sizeof(length));
+	if (!rejected(damaged, n))
+	{
+	    std::cout<<"FAILED: a damaged chunk table is accepted"<<std::endl;
+	    ok=false;
+	}
+    }
+    return ok;
+}
+
+/**
+ * @brief A function to check compressed blocks in an archive
+ *
+ * @return true if the lossless block comes back exactly, and the lossy
+ * one has the elements below the threshold set to zero and the rest
+ * exact
+ */
+bool checkArchive(const std::string& fileName)
+{
+    const double threshold=1e-3;
+    blitz::Array<double,2> matrix(100, 300);
+    blitz::firstIndex i;
+    blitz::secondIndex j;
+    matrix=(i-j)*cos(0.1*i*j)/300.0;
+
+    BlockArchive archive(fileName);
+    const BlockArchive::Record lossless=archive.write(BlockKey(3, 'l'),
+	    matrix, BlockCompression(true));
+    const BlockArchive::Record lossy=archive.write(BlockKey(3, 'r'),
+	    matrix, BlockCompression(true, threshold));
+
+    blitz::Array<double,2> result;
+    archive.readRecord(lossless, result);
+    bool ok=true;
+    if (any(result!=matrix))
+    {
+	std::cout<<"FAILED: the lossless block is not the same"<<std::endl;
+	ok=false;
+    }
+
+    archive.readRecord(lossy, result);
+    const int zeros=count(result==0.0);
+    const int small=count(abs(matrix)<threshold);
+    std::cout<<"archive: "<<small<<" of "<<matrix.numElements()
+	<<" elements below the threshold, "<<zeros<<" zeros in the lossy block"
+	<<std::endl;
+    if (any(where(abs(matrix)<threshold, result!=0.0, result!=matrix)))
+    {
+	std::cout<<"FAILED: the lossy block is not the thresholded one"
+	    <<std::endl;
+	ok=false;
+    }
+    if (small==0 || small==matrix.numElements())
+    {
+	std::cout<<"FAILED: the threshold drops all or nothing"<<std::endl;
+	ok=false;
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc!=2)
+    {
+	std::cerr<<"usage: "<<argv[0]<<" scratchDirectory"<<std::endl;
+	return 2;
+    }
+
+    try
+    {
+	bool ok=true;
+	ok=checkRoundTrip("empty", std::vector<double>()) && ok;
+	ok=checkRoundTrip("one element", smoothData(1)) && ok;
+	ok=checkRoundTrip("part of a chunk", smoothData(CODEC_CHUNK/3)) && ok;
+	ok=checkRoundTrip("one chunk", smoothData(CODEC_CHUNK)) && ok;
+	ok=checkRoundTrip("several chunks", smoothData(3*CODEC_CHUNK+17))
+	    && ok;
+	ok=checkRoundTrip("incompressible", randomData(2*CODEC_CHUNK+5))
+	    && ok;
+
+	const std::string fileName=std::string(argv[1])+"/codecTest.dmrg";
+	const bool archiveOk=checkArchive(fileName);
+	remove(fileName.c_str());
+	return (ok && archiveOk)? 0 : 1;
+    }
+    catch (const dmrg::Exception& e)
+    {
+	std::cout<<"FAILED: "<<e.what()<<std::endl;
+	return 1;
+    }
+}
+// end codecTest.cpp
@@ -0,0 +1,377 @@
+/**
+ * @file linearAlgebraTest.cpp
+ *
+ * @brief A test of the dense linear algebra backends
+ *
+ * Runs every kernel of each backend in the build, the reference one and
+ * the BLAS/LAPACK one of <tt>make lapack=1</tt>, on small random
+ * matrices, and compares the results with plain loops: gemm and gemv for
+ * both transposes and matrices stored by rows, as transposed views and
+ * as strided slices; syrk, which must leave the upper triangle alone;
+ * the eigenvectors of a symmetric matrix, which must be orthonormal and
+ * satisfy the eigenvalue equation; and the singular value decomposition
+ * of tall and wide matrices, which must give back the matrix. Run it
+ * through
+ *
+ * \code $ make check \endcode
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include "blitz/array.h"
+#include "exceptions.h"
+#include "linearAlgebra.h"
+
+/// the largest difference allowed with the plain loops, relative to the
+/// size of the elements
+const double TOLERANCE=1e-11;
+
+/// how the elements of a test matrix are stored
+enum Storage { ROW_MAJOR, TRANSPOSED, STRIDED };
+
+const char* storageName(Storage storage)
+{
+    switch (storage)
+    {
+	case ROW_MAJOR: return "rows";
+	case TRANSPOSED: return "transposed";
+	default: return "strided";
+    }
+}
+
+/// a random number in [-1,1)
+double randomNumber(uint64_t& state)
+{
+    state=state*6364136223846793005ull+1442695040888963407ull;
+    return double(state>>11)/double(1ull<<52)-1.0;
+}
+
+/**
+ * @brief A function to make a random matrix
+ *
+ * @return a rows x cols matrix stored by rows, a transposed view of a
+ * matrix stored by rows, or a slice with strides in both dimensions of a
+ * larger matrix, that the backends must copy
+ */
+blitz::Array<double,2> randomMatrix(int rows, int cols, Storage storage,
+	uint64_t& state)
+{
+    blitz::Array<double,2> result;
+    if (storage==ROW_MAJOR)
+	result.reference(blitz::Array<double,2>(rows, cols));
+    else if (storage==TRANSPOSED)
+    {
+	blitz::Array<double,2> stored(cols, rows);
+	result.reference(stored.transpose(blitz::secondDim, blitz::firstDim));
+    }
+    else
+    {
+	blitz::Array<double,2> stored(2*rows, 3*cols);
+	result.reference(stored(blitz::Range(0, 2*(rows-1), 2),
+		    blitz::Range(0, 3*(cols-1), 3)));
+    }
+    for (int i=0; i<rows; i++)
+	for (int j=0; j<cols; j++)
+	    result(i,j)=randomNumber(state);
+    return result;
+}
+
+/// a random vector, contiguous or with a stride
+blitz::Array<double,1> randomVector(int n, bool strided, uint64_t& state)
+{
+    blitz::Array<double,1> result;
+    if (strided)
+    {
+	blitz::Array<double,1> stored(2*n);
+	result.reference(stored(blitz::Range(0, 2*(n-1), 2)));
+    }
+    else
+	result.reference(blitz::Array<double,1>(n));
+    for (int i=0; i<n; i++)
+	result(i)=randomNumber(state);
+    return result;
+}
+
+/// element (i,j) of op(a)
+double opElement(const blitz::Array<double,2>& a, bool transpose, int i,
+	int j)
+{
+    return transpose? a(j,i) : a(i,j);
+}
+
+/// prints the failure if the difference is too large
+bool close(double difference, const std::string& what)
+{
+    if (difference<=TOLERANCE)
+	return true;
+    std::cout<<"FAILED: "<<what<<", difference "<<difference<<std::endl;
+    return false;
+}
+
+/**
+ * @brief A function to check gemm
+ *
+ * @return true if c=alpha*op(a)*op(b)+beta*c agrees with the loops for
+ * all the transposes and storages of a, b and c
+ */
+bool checkGemm(LinearAlgebraBackend& backend, uint64_t& state)
+{
+    const int m=7, k=5, n=9;
+    const double alpha=0.7, beta=-1.3;
+    const Storage storages[]={ROW_MAJOR, TRANSPOSED, STRIDED};
+    bool ok=true;
+    for (int t=0; t<4; t++)
+	for (int sa=0; sa<3; sa++)
+	    for (int sb=0; sb<3; sb++)
+		for (int sc=0; sc<3; sc++)
+		{
+		    const bool ta=t&1, tb=t&2;
+		    blitz::Array<double,2> a=randomMatrix(ta? k : m, ta? m : k,
+			    storages[sa], state);
+		    blitz::Array<double,2> b=randomMatrix(tb? n : k, tb? k : n,
+			    storages[sb], state);
+		    blitz::Array<double,2> c=randomMatrix(m, n, storages[sc],
+			    state);
+		    blitz::Array<double,2> expected(m, n);
+		    for (int i=0; i<m; i++)
+			for (int j=0; j<n; j++)
+			{
+			    double sum=0.0;
+			    for (int p=0; p<k; p++)
+				sum+=opElement(a, ta, i, p)*
+				    opElement(b, tb, p, j);
+			    expected(i,j)=alpha*sum+beta*c(i,j);
+			}
+
+		    backend.gemm(ta, tb, alpha, a, b, beta, c);
+		    ok=close(max(abs(c-expected)), backend.name()+" gemm "+
+			    (ta? "T" : "N")+(tb? "T" : "N")+" a "+
+			    storageName(storages[sa])+", b "+
+			    storageName(storages[sb])+", c "+
+			    storageName(storages[sc])) && ok;
+		}
+    return ok;
+}
+
+/**
+ * @brief A function to check gemv
+ *
+ * @return true if y=alpha*op(a)*x+beta*y agrees with the loops for both
+ * transposes and all the storages of a, x and y
+ */
+bool checkGemv(LinearAlgebraBackend& backend, uint64_t& state)
+{
+    const int m=11, n=6;
+    const double alpha=-0.4, beta=2.1;
+    const Storage storages[]={ROW_MAJOR, TRANSPOSED, STRIDED};
+    bool ok=true;
+    for (int ta=0; ta<2; ta++)
+	for (int sa=0; sa<3; sa++)
+	    for (int sv=0; sv<4; sv++)
+	    {
+		blitz::Array<double,2> a=randomMatrix(ta? n : m, ta? m : n,
+			storages[sa], state);
+		blitz::Array<double,1> x=randomVector(n, sv&1, state);
+		blitz::Array<double,1> y=randomVector(m, sv&2, state);
+		blitz::Array<double,1> expected(m);
+		for (int i=0; i<m; i++)
+		{
+		    double sum=0.0;
+		    for (int j=0; j<n; j++)
+			sum+=opElement(a, ta, i, j)*x(j);
+		    expected(i)=alpha*sum+beta*y(i);
+		}
+
+		backend.gemv(ta, alpha, a, x, beta, y);
+		ok=close(max(abs(y-expected)), backend.name()+" gemv "+
+			(ta? "T" : "N")+" a "+storageName(storages[sa])+
+			(sv&1? ", x strided" : "")+(sv&2? ", y strided" : ""))
+		    && ok;
+	    }
+    return ok;
+}
+
+/**
+ * @brief A function to check syrk
+ *
+ * @return true if the lower triangle of c gets alpha*a*a^T added, and
+ * the upper triangle is not touched, for all the storages of a. The
+ * sizes cross the tiles of the reference kernels
+ */
+bool checkSyrk(LinearAlgebraBackend& backend, uint64_t& state)
+{
+    const int n=70, k=300;
+    const double alpha=0.3;
+    const Storage storages[]={ROW_MAJOR, TRANSPOSED, STRIDED};
+    bool ok=true;
+    for (int sa=0; sa<3; sa++)
+    {
+	blitz::Array<double,2> a=randomMatrix(n, k, storages[sa], state);
+	blitz::Array<double,2> c=randomMatrix(n, n, ROW_MAJOR, state);
+	blitz::Array<double,2> expected(n, n);
+	expected=c;
+	for (int i=0; i<n; i++)
+	    for (int j=0; j<=i; j++)
+	    {
+		double sum=0.0;
+		for (int p=0; p<k; p++)
+		    sum+=a(i,p)*a(j,p);
+		expected(i,j)+=alpha*sum;
+	    }
+
+	backend.syrk(alpha, a, c);
+	// the sums have k terms
+	ok=close(max(abs(c-expected))/k, backend.name()+" syrk a "+
+		storageName(storages[sa])) && ok;
+    }
+    return ok;
+}
+
+/**
+ * @brief A function to check the eigensystem of a symmetric matrix
+ *
+ * @return true if the eigenvectors are orthonormal and a*v=lambda*v for
+ * each of them
+ */
+bool checkEigensystem(LinearAlgebraBackend& backend, uint64_t& state)
+{
+    const int n=30;
+    blitz::Array<double,2> matrix=randomMatrix(n, n, ROW_MAJOR, state);
+    for (int i=0; i<n; i++)
+	for (int j=0; j<i; j++)
+	    matrix(j,i)=matrix(i,j);
+
+    blitz::Array<double,2> vectors(n, n);
+    vectors=matrix;
+    blitz::Array<double,1> eigenvalues(n);
+    backend.symmetricEigensystem(vectors, eigenvalues);
+
+    double residual=0.0, orthogonality=0.0;
+    for (int i=0; i<n; i++)
+    {
+	for (int j=0; j<n; j++)
+	{
+	    double sum=-eigenvalues(i)*vectors(j,i);
+	    for (int p=0; p<n; p++)
+		sum+=matrix(j,p)*vectors(p,i);
+	    residual=std::max(residual, fabs(sum));
+
+	    double product=(i==j)? -1.0 : 0.0;
+	    for (int p=0; p<n; p++)
+		product+=vectors(p,i)*vectors(p,j);
+	    orthogonality=std::max(orthogonality, fabs(product));
+	}
+    }
+    std::cout<<backend.name()<<" symmetricEigensystem: residual "<<residual
+	<<", orthogonality "<<orthogonality<<std::endl;
+    // the sums have n terms
+    const bool residualOk=close(residual/n, backend.name()+
+	    " symmetricEigensystem residual");
+    const bool orthogonalityOk=close(orthogonality/n, backend.name()+
+	    " symmetricEigensystem orthogonality");
+    return residualOk && orthogonalityOk;
+}
+
+/**
+ * @brief A function to check the singular value decomposition
+ *
+ * @return true if the singular values are positive and in decreasing
+ * order, the singular vectors are orthonormal and u*diag(s)*vt is the
+ * matrix
+ */
+bool checkSvd(LinearAlgebraBackend& backend, int rows, int cols,
+	Storage storage, uint64_t& state)
+{
+    const int k=std::min(rows, cols);
+    blitz::Array<double,2> a=randomMatrix(rows, cols, storage, state);
+    blitz::Array<double,2> u(rows, k), vt(k, cols);
+    blitz::Array<double,1> s(k);
+    backend.svd(a, u, s, vt);
+
+    std::string what=backend.name()+" svd ";
+    what+=(rows>cols? "tall " : "wide ");
+    what+=storageName(storage);
+    bool ok=true;
+    for (int p=0; p<k; p++)
+	if (s(p)<0.0 || (p>0 && s(p)>s(p-1)))
+	{
+	    std::cout<<"FAILED: "<<what<<": the singular values are not "
+		"positive and decreasing"<<std::endl;
+	    ok=false;
+	    break;
+	}
+
+    double reconstruction=0.0, uOrthogonality=0.0, vOrthogonality=0.0;
+    for (int i=0; i<rows; i++)
+	for (int j=0; j<cols; j++)
+	{
+	    double sum=-a(i,j);
+	    for (int p=0; p<k; p++)
+		sum+=u(i,p)*s(p)*vt(p,j);
+	    reconstruction=std::max(reconstruction, fabs(sum));
+	}
+    for (int p=0; p<k; p++)
+	for (int q=0; q<k; q++)
+	{
+	    double uProduct=(p==q)? -1.0 : 0.0;
+	    for (int i=0; i<rows; i++)
+		uProduct+=u(i,p)*u(i,q);
+	    uOrthogonality=std::max(uOrthogonality, fabs(uProduct));
+	    double vProduct=(p==q)? -1.0 : 0.0;
+	    for (int j=0; j<cols; j++)
+		vProduct+=vt(p,j)*vt(q,j);
+	    vOrthogonality=std::max(vOrthogonality, fabs(vProduct));
+	}
+    ok=close(reconstruction/k, what+" reconstruction") && ok;
+    ok=close(uOrthogonality/rows, what+" orthogonality of u") && ok;
+    ok=close(vOrthogonality/cols, what+" orthogonality of vt") && ok;
+    return ok;
+}
+
+/// runs all the checks on a backend
+bool checkBackend(LinearAlgebraBackend& backend)
+{
+    uint64_t state=12345;
+    bool ok=true;
+    ok=checkGemm(backend, state) && ok;
+    ok=checkGemv(backend, state) && ok;
+    ok=checkSyrk(backend, state) && ok;
+    ok=checkEigensystem(backend, state) && ok;
+    ok=checkSvd(backend, 12, 5, ROW_MAJOR, state) && ok;
+    ok=checkSvd(backend, 5, 12, ROW_MAJOR, state) && ok;
+    ok=checkSvd(backend, 12, 5, TRANSPOSED, state) && ok;
+    ok=checkSvd(backend, 5, 12, STRIDED, state) && ok;
+    std::cout<<backend.name()<<": "<<(ok? "ok" : "FAILED")<<std::endl;
+    return ok;
+}
+
+int main()
+{
+    try
+    {
+	bool ok=true;
+	const char* names[]={"reference", "lapack"};
+	for (int i=0; i<2; i++)
+	{
+	    LinearAlgebraBackend* backend=findLinearAlgebraBackend(names[i]);
+	    if (backend)
+		ok=checkBackend(*backend) && ok;
+	    else
+		std::cout<<names[i]<<": not in this build"<<std::endl;
+	}
+	return ok? 0 : 1;
+    }
+    catch (const dmrg::Exception& e)
+    {
+	std::cout<<"FAILED: "<<e.what()<<std::endl;
+	return 1;
+    }
+}
+// end linearAlgebraTest.cpp
@@ -0,0 +1,185 @@
+/**
+ * @file mpsTest.cpp
+ *
+ * @brief A test of the ground state exported as a matrix product state
+ *
+ * Reads the MPS saved by a run (see the mps option of heisenberg.cpp),
+ * expands it into the full wavefunction of the chain and checks that its
+ * norm is one and that the energy of the Heisenberg Hamiltonian on it is
+ * the energy of the run. It also writes the state again, reads it back
+ * and checks the overlap of both copies. Besides, it puts together a
+ * state of sites with three states from known blocks and checks its
+ * amplitudes. Run it through
+ *
+ * \code $ make check \endcode
+ *
+ * which does a small run with fixed parameters first. The chain must be
+ * short (the full wavefunction is built), a dozen sites at most.
+ *
+ * @author Roger Melko
+ * @author Ivan Gonzalez
+ * @date $Date$
+ *
+ * $Revision$
+ */
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include "blitz/array.h"
+#include "exceptions.h"
+#include "blockStore.h"
+#include "mps.h"
+
+/**
+ * @brief A function to expand a matrix product state
+ *
+ * @return the amplitudes of the configurations of the chain, with the
+ * state of site n as the digit N-1-n of the index in base d. For spins,
+ * 0 is up and 1 down
+ */
+blitz::Array<double,1> expandState(const MatrixProductState& mps)
+{
+    const int d=mps.siteStates;
+    // partial(c,b): the configurations c of the sites done so far, and
+    // the bond b to the next site
+    blitz::Array<double,2> partial(1,1);
+    partial=1.0;
+    for (size_t n=0; n<mps.tensors.size(); n++)
+    {
+	const blitz::Array<double,3>& A=mps.tensors[n];
+	blitz::Array<double,2> next(d*partial.rows(), A.extent(blitz::thirdDim));
+	next=0.0;
+	for (int c=0; c<partial.rows(); c++)
+	    for (int s=0; s<d; s++)
+		for (int a=0; a<A.extent(blitz::firstDim); a++)
+		    for (int b=0; b<A.extent(blitz::thirdDim); b++)
+			next(d*c+s,b)+=partial(c,a)*A(a,s,b);
+	partial.reference(next);
+    }
+    return partial(blitz::Range::all(), 0).copy();
+}
+
+/**
+ * @brief A function to calculate the energy of a wavefunction of the
+ * Heisenberg chain with open ends
+ */
+double heisenbergEnergy(const blitz::Array<double,1>& psi, int sites)
+{
+    double result=0.0;
+    for (int c=0; c<psi.size(); c++)
+	for (int n=0; n<sites-1; n++)
+	{
+	    const int bits=(c>>(sites-2-n))&3;
+	    if (bits==0 || bits==3)
+		result+=0.25*psi(c)*psi(c);
+	    else
+	    {
+		const int flipped=c^(3<<(sites-2-n));
+		result+=-0.25*psi(c)*psi(c)+0.5*psi(c)*psi(flipped);
+	    }
+	}
+    return result;
+}
+
+/**
+ * @brief A function to check a state of sites with three states
+ *
+ * Builds the state of five sites from a left block of three sites,
+ * whose truncation matrix only permutes the states, and a right block of
+ * two.
+ *
+ * @return true if each configuration has its amplitude in psi
+ */
+bool checkSiteStates()
+{
+    const int d=3;
+    BlockStore& store=defaultBlockStore();
+    // the block of two sites keeps all the states, in another order
+    blitz::Array<double,2> OO(d*d, d*d);
+    OO=0.0;
+    for (int i=0; i<d*d; i++)
+	OO((5*i+2)%(d*d),i)=1.0;
+    store.putTransformation(BlockKey(2, 'l'), OO);
+
+    blitz::Array<double,2> psi(d*d*d, d*d);
+    blitz::firstIndex i;
+    blitz::secondIndex j;
+    psi=cos(1.0+i+0.3*i*j);
+    MatrixProductState mps=buildMatrixProductState(store, d, 3, 2, psi);
+    blitz::Array<double,1> state=expandState(mps);
+
+    bool ok=(mps.siteStates==d && mps.tensors.size()==5 &&
+	    state.size()==d*d*d*d*d);
+    for (int c=0; ok && c<state.size(); c++)
+    {
+	const int s0=c/(d*d*d*d), s1=c/(d*d*d)%d, s2=c/(d*d)%d,
+	      s3=c/d%d, s4=c%d;
+	// the rows of psi are the states of the left block and of site 2,
+	// its columns those of site 4 and site 3
+	const int left=(5*(s0*d+s1)+2)%(d*d);
+	ok=(state(c)==psi(left*d+s2, s4*d+s3));
+    }
+    std::cout<<"three states per site: "<<(ok? "ok" : "FAILED")<<std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc!=2)
+    {
+	std::cerr<<"usage: "<<argv[0]<<" state.mps"<<std::endl;
+	return 2;
+    }
+
+    try
+    {
+	MatrixProductState mps;
+	readMatrixProductState(argv[1], mps);
+	const int sites=mps.tensors.size();
+	if (mps.siteStates!=2)
+	    throw dmrg::Exception("the state is not of a spin 1/2 chain");
+
+	blitz::Array<double,1> psi=expandState(mps);
+	const double norm=sum(psi*psi);
+	const double energy=heisenbergEnergy(psi, sites)/norm;
+
+	// write it again and read it back
+	const std::string copyName=std::string(argv[1])+".copy";
+	writeMatrixProductState(copyName, mps);
+	MatrixProductState copy;
+	readMatrixProductState(copyName, copy);
+	remove(copyName.c_str());
+	const double copyOverlap=overlap(mps, copy);
+
+	std::cout.precision(12);
+	std::cout<<sites<<" sites: norm "<<norm<<", overlap with the copy "
+	    <<copyOverlap<<", energy "<<energy<<" (run "<<mps.energy<<")"
+	    <<std::endl;
+
+	bool ok=checkSiteStates();
+	if (fabs(norm-1.0)>1e-8 || fabs(overlap(mps, mps)-norm)>1e-8)
+	{
+	    std::cout<<"FAILED: the state is not normalized"<<std::endl;
+	    ok=false;
+	}
+	if (fabs(copyOverlap-norm)>1e-12)
+	{
+	    std::cout<<"FAILED: the copy is not the same state"<<std::endl;
+	    ok=false;
+	}
+	if (fabs(energy-mps.energy)>1e-6*sites)
+	{
+	    std::cout<<"FAILED: the energy is not the one of the run"
+		<<std::endl;
+	    ok=false;
+	}
+	return ok? 0 : 1;
+    }
+    catch (const dmrg::Exception& e)
+    {
+	std::cout<<"FAILED: "<<e.what()<<std::endl;
+	return 1;
+    }
+}
+// end mpsTest.cpp